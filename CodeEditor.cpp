@@ -1,19 +1,33 @@
 #include "CodeEditor.h"
+#include "LuaStructure.h"
 
 #include <QtWidgets>
 #include <QTextCursor>
 
+#include <algorithm>
 
-CodeEditor::CodeEditor(QWidget *parent) : QTextEdit(parent)
+
+CodeEditor::CodeEditor(QWidget *parent) : QPlainTextEdit(parent),
+	m_visibleFirst( -1 ),
+	m_visibleLast( -1 ),
+	m_errorLine( 0 ),
+	m_pausedLine( 0 ),
+	m_blockCount( 1 )
 {
 	lineNumberArea = new LineNumberArea(this);
+	lineNumberArea->setObjectName( QStringLiteral( "lineNumberArea" ) );
+
+	// first to hear of edits, so it is up to date for everything after
+	m_structure = new LuaStructure( document() );
+	connect( m_structure, &LuaStructure::updated, this, [this]{ lineNumberArea->update(); } );
+	connect( document(), &QTextDocument::contentsChange, this, &CodeEditor::contentsChange );
 
-	connect( this->document(), &QTextDocument::blockCountChanged, this, &CodeEditor::updateLineNumberAreaWidth );
-	connect( this->verticalScrollBar(), &QScrollBar::valueChanged, this, &CodeEditor::updateLineNumberArea );
-	connect( this, &QTextEdit::textChanged, this, &CodeEditor::updateLineNumberArea );
-	connect( this, &QTextEdit::cursorPositionChanged, this, &CodeEditor::updateLineNumberArea );
+	// plain source only, never wrap so every block is one line high
+	setLineWrapMode( QPlainTextEdit::NoWrap );
 
-	connect( this, &QTextEdit::cursorPositionChanged, this, &CodeEditor::highlightCurrentLine );
+	connect( this, &QPlainTextEdit::blockCountChanged, this, &CodeEditor::updateLineNumberAreaWidth );
+	connect( this, &QPlainTextEdit::updateRequest, this, &CodeEditor::updateLineNumberArea );
+	connect( this, &QPlainTextEdit::cursorPositionChanged, this, &CodeEditor::highlightCurrentLine );
 
 	updateLineNumberAreaWidth(0);
 	highlightCurrentLine();
@@ -24,55 +38,71 @@ int CodeEditor::lineNumberAreaWidth()
 {
 	int digits = 1;
 
-	int max = qMax(1, document()->blockCount());
+	int max = qMax(1, blockCount());
 	while (max >= 10) {
 		max /= 10;
 		++digits;
 	}
 
-	int space = 6 + fontMetrics().width(QLatin1Char('9')) * digits;
+	// breakpoint markers, numbers, fold markers
+	int space = 6 + fontMetrics().width(QLatin1Char('9')) * digits + 2 * foldAreaWidth();
 
 	return space;
 }
 
 
+// columns of breakpoint and fold markers, either side of the line numbers
+int CodeEditor::foldAreaWidth( void ) const
+{
+	return fontMetrics().height();
+}
 
-void CodeEditor::updateLineNumberAreaWidth(int /* newBlockCount */)
+
+LuaStructure* CodeEditor::structure( void ) const
 {
-	setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+	return m_structure;
 }
 
 
 
-void CodeEditor::updateLineNumberArea()
+void CodeEditor::updateLineNumberAreaWidth(int /* newBlockCount */)
 {
-	// Make sure the sliderPosition triggers one last time the valueChanged() signal with the actual value !!!!
-	verticalScrollBar()->setSliderPosition( verticalScrollBar()->sliderPosition() );
+	setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+}
 
-	// Since "QTextEdit" does not have an "updateRequest(...)" signal, we chose
-	// to grab the imformations from "sliderPosition()" and "contentsRect()".
-	// See the necessary connections used (Class constructor implementation part).
 
-	updateLineNumberAreaWidth( 0 );
 
-	int dy = verticalScrollBar()->sliderPosition();
-	if( dy > -1 )
+void CodeEditor::updateLineNumberArea( QRect const& rect, int dy )
+{
+	// scrolling moves what is already drawn, anything else repaints only
+	// the rows the editor itself is repainting
+	if( dy )
 	{
 		lineNumberArea->scroll( 0, dy );
 	}
+	else
+	{
+		lineNumberArea->update( 0, rect.y(), lineNumberArea->width(), rect.height() );
+	}
 
-	QRect crect = contentsRect();
-	lineNumberArea->update( 0, crect.y(), lineNumberArea->width(), crect.height() );
+	if( rect.contains( viewport()->rect() ) )
+	{
+		updateLineNumberAreaWidth( 0 );
+	}
+
+	updateVisibleBlocks();
 }
 
 
 
 void CodeEditor::resizeEvent(QResizeEvent *e)
 {
-	QTextEdit::resizeEvent(e);
+	QPlainTextEdit::resizeEvent(e);
 
 	QRect cr = contentsRect();
 	lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
+
+	updateVisibleBlocks();
 }
 
 
@@ -88,6 +118,34 @@ void CodeEditor::keyPressEvent(QKeyEvent *e)
 		}
 	}
 
+	if( e->key() == Qt::Key_F && e->modifiers() == Qt::ControlModifier )
+	{
+		e->accept();
+		emit requestFind();
+		return;
+	}
+
+	if( e->key() == Qt::Key_F9 && e->modifiers() == Qt::NoModifier )
+	{
+		e->accept();
+		toggleBreakpoint( textCursor().blockNumber() + 1 );
+		return;
+	}
+
+	if( e->key() == Qt::Key_Backtab )
+	{
+		e->accept();
+		decreaseSelectionIndent();
+		return;
+	}
+
+	if( e->key() == Qt::Key_Slash && e->modifiers() == Qt::ControlModifier )
+	{
+		e->accept();
+		toggleSelectionComment();
+		return;
+	}
+
 	if( e->key() == Qt::Key_Tab )
 	{
 		if( increaseSelectionIndent() )
@@ -97,18 +155,24 @@ void CodeEditor::keyPressEvent(QKeyEvent *e)
 		}
 	}
 
-	QTextEdit::keyPressEvent( e );
+	QPlainTextEdit::keyPressEvent( e );
 }
 
 
 void CodeEditor::changeEvent( QEvent* e )
 {
-	QTextEdit::changeEvent( e );
+	QPlainTextEdit::changeEvent( e );
 
 	if( e->type() == QEvent::PaletteChange )
 	{
 		highlightCurrentLine();
 	}
+
+	if( e->type() == QEvent::FontChange )
+	{
+		m_numbers.clear();
+		updateLineNumberAreaWidth( 0 );
+	}
 }
 
 
@@ -116,6 +180,18 @@ void CodeEditor::highlightCurrentLine()
 {
 	QList<QTextEdit::ExtraSelection> extraSelections;
 
+	// the cursor was taken into folded lines (by find, say), show them
+	QTextBlock current = textCursor().block();
+	if( ! current.isVisible() )
+	{
+		QTextBlock header = current;
+		while( header.isValid() && ! header.isVisible() )
+		{
+			header = header.previous();
+		}
+		unfold( header.blockNumber() );
+	}
+
 	if( !isReadOnly() )
 	{
 		QTextEdit::ExtraSelection selection;
@@ -129,122 +205,670 @@ void CodeEditor::highlightCurrentLine()
 		extraSelections.append( selection );
 	}
 
+	QTextBlock paused = document()->findBlockByNumber( m_pausedLine - 1 );
+	if( m_pausedLine > 0 && paused.isValid() )
+	{
+		QTextEdit::ExtraSelection selection;
+		selection.format.setBackground( QColor( 255, 240, 120 ) );
+		selection.format.setProperty( QTextFormat::FullWidthSelection, true );
+		selection.cursor = QTextCursor( paused );
+		extraSelections.append( selection );
+	}
+
+	// the keyword or bracket at the cursor and what it pairs with
+	LuaStructure::Token token;
+	QVector<LuaStructure::Token> partners;
+	if( m_structure->match( textCursor().position(), &token, &partners ) )
+	{
+		QTextEdit::ExtraSelection selection;
+		selection.format.setBackground( partners.isEmpty() ? QColor( 255, 160, 160 ) : QColor( 170, 230, 170 ) );
+
+		partners.prepend( token );
+		for( auto const& t : partners )
+		{
+			selection.cursor = QTextCursor( document() );
+			selection.cursor.setPosition( t.position );
+			selection.cursor.setPosition( t.position + t.length, QTextCursor::KeepAnchor );
+			extraSelections.append( selection );
+		}
+	}
+
+	// search matches, only those on screen (there may be very many)
+	if( ! m_matches.isEmpty() && m_visibleFirst >= 0 )
+	{
+		QTextBlock last = document()->findBlockByNumber( m_visibleLast );
+		int from = document()->findBlockByNumber( m_visibleFirst ).position();
+		int to = last.isValid() ? last.position() + last.length() : document()->characterCount();
+
+		QTextEdit::ExtraSelection selection;
+		selection.format.setBackground( QColor( 255, 230, 0, 128 ) );
+
+		auto it = std::lower_bound( m_matches.constBegin(), m_matches.constEnd(), from,
+			[]( SearchIndex::Match const& m, int pos ){ return m.position < pos; } );
+		for( ; it != m_matches.constEnd() && it->position < to; ++it )
+		{
+			selection.cursor = QTextCursor( document() );
+			selection.cursor.setPosition( it->position );
+			selection.cursor.setPosition( it->position + it->length, QTextCursor::KeepAnchor );
+			extraSelections.append( selection );
+		}
+	}
+
+	QTextBlock error = document()->findBlockByNumber( m_errorLine - 1 );
+	if( m_errorLine > 0 && error.isValid() )
+	{
+		QTextEdit::ExtraSelection selection;
+		selection.format.setUnderlineStyle( QTextCharFormat::WaveUnderline );
+		selection.format.setUnderlineColor( Qt::red );
+		selection.cursor = QTextCursor( error );
+		selection.cursor.movePosition( QTextCursor::EndOfBlock, QTextCursor::KeepAnchor );
+		extraSelections.append( selection );
+	}
+
 	setExtraSelections( extraSelections );
 }
 
 
-QTextBlock CodeEditor::findFirstVisibleBlock( void )
+void CodeEditor::updateVisibleBlocks( void )
 {
-	QTextDocument* doc = document();
-	QTextBlock block = doc->begin();
+	QTextBlock block = firstVisibleBlock();
+	if( ! block.isValid() )
+	{
+		return;
+	}
+
+	int first = block.blockNumber();
+	int last = first;
+	int bottom = viewport()->rect().bottom();
 
-	QRect vp_box( viewport()->geometry() );
-	QPoint trans( vp_box.x(), vp_box.y() - verticalScrollBar()->sliderPosition() );
+	qreal top = blockBoundingGeometry( block ).translated( contentOffset() ).top();
+	while( block.isValid() && top <= bottom )
+	{
+		last = block.blockNumber();
+		top += blockBoundingRect( block ).height();
+		block = nextVisible( block );
+	}
 
-	while( block != doc->end() )
+	if( first != m_visibleFirst || last != m_visibleLast )
 	{
-		QRect block_box = doc->documentLayout()->blockBoundingRect( block ).translated( trans ).toRect();
-		if( vp_box.intersects( block_box ) )
+		m_visibleFirst = first;
+		m_visibleLast = last;
+		emit visibleBlocksChanged( first, last );
+
+		if( ! m_matches.isEmpty() )
 		{
-			break;
+			highlightCurrentLine();
 		}
-		block = block.next();
 	}
-
-	return block;
 }
 
 
 
 void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
 {
-	verticalScrollBar()->setSliderPosition(this->verticalScrollBar()->sliderPosition());
-
 	QPainter painter( lineNumberArea );
 	painter.fillRect( event->rect(), Qt::lightGray );
 	painter.setPen( Qt::black );
 
-	QTextDocument* doc = document();
-	QAbstractTextDocumentLayout* layout = doc->documentLayout();
-
-	QTextBlock block = findFirstVisibleBlock();
+	QTextBlock block = firstVisibleBlock();
 	int blockNumber = block.blockNumber();
 
-	qreal top = viewport()->geometry().top()
-				+ doc->documentMargin()
-				- 5
-				- verticalScrollBar()->sliderPosition()
-				+ layout->blockBoundingRect( block ).top();
-
-	QRectF box( 0, top, lineNumberArea->width() - 3, 1 );
+	int fold = foldAreaWidth();
+	qreal top = blockBoundingGeometry( block ).translated( contentOffset() ).top();
+	QRectF box( 0, top, lineNumberArea->width() - fold - 3, 1 );
 
 	while( block.isValid() && box.top() <= event->rect().bottom() )
 	{
-		box.setHeight( layout->blockBoundingRect( block ).height() );
+		box.setHeight( blockBoundingRect( block ).height() );
+		++blockNumber;
 
 		if( block.isVisible() && box.bottom() >= event->rect().top() )
 		{
-			painter.drawText( box, Qt::AlignRight, QString::number( ++blockNumber ) );
+			auto it = m_numbers.find( blockNumber );
+			if( it == m_numbers.end() )
+			{
+				// keep the cache around a few screens worth of numbers
+				if( m_numbers.size() > 4096 )
+				{
+					m_numbers.clear();
+				}
+
+				QStaticText text( QString::number( blockNumber ) );
+				text.setTextFormat( Qt::PlainText );
+				text.prepare( QTransform(), lineNumberArea->font() );
+				it = m_numbers.insert( blockNumber, text );
+			}
+
+			if( blockNumber == m_errorLine )
+			{
+				painter.fillRect( box.adjusted( 0, 0, 3, 0 ), Qt::red );
+			}
+
+			auto heat = m_heat.constFind( blockNumber );
+			if( heat != m_heat.constEnd() )
+			{
+				painter.fillRect( box, QColor( 255, 0, 0, 32 + int( 191 * heat.value() ) ) );
+			}
+
+			painter.drawStaticText( QPointF( box.right() - it->size().width(), box.top() ), *it );
+
+			qreal mid = box.center().y();
+			if( m_breakpoints.contains( blockNumber ) )
+			{
+				painter.setPen( Qt::NoPen );
+				painter.setBrush( Qt::red );
+				painter.drawEllipse( QPointF( fold / 2.0, mid ), fold / 3.0, fold / 3.0 );
+				painter.setPen( Qt::black );
+			}
+
+			if( blockNumber == m_pausedLine )
+			{
+				QPolygonF arrow;
+				arrow << QPointF( fold / 4.0, mid - fold / 4.0 ) << QPointF( fold * 0.8, mid ) << QPointF( fold / 4.0, mid + fold / 4.0 );
+				painter.setPen( Qt::black );
+				painter.setBrush( QColor( 255, 220, 0 ) );
+				painter.drawPolygon( arrow );
+			}
+
+			if( m_structure->isFoldable( blockNumber - 1 ) )
+			{
+				// a triangle, pointing right while folded
+				qreal x = lineNumberArea->width() - fold / 2.0;
+				qreal y = mid;
+				qreal r = fold / 4.0;
+
+				QPolygonF marker;
+				if( block.next().isValid() && ! block.next().isVisible() )
+				{
+					marker << QPointF( x - r / 2, y - r ) << QPointF( x + r / 2, y ) << QPointF( x - r / 2, y + r );
+				}
+				else
+				{
+					marker << QPointF( x - r, y - r / 2 ) << QPointF( x + r, y - r / 2 ) << QPointF( x, y + r / 2 );
+				}
+
+				painter.setPen( Qt::NoPen );
+				painter.setBrush( Qt::darkGray );
+				painter.drawPolygon( marker );
+				painter.setPen( Qt::black );
+			}
 		}
 
-		block = block.next();
+		// folded lines are stepped over, not walked
+		QTextBlock next = nextVisible( block );
+		if( next.isValid() && next != block.next() )
+		{
+			blockNumber = next.blockNumber();
+		}
+
+		block = next;
 		box.translate( 0, box.height() );
 	}
 }
 
 
-bool CodeEditor::increaseSelectionIndent( void )
+// fold markers toggle folding, anywhere else a breakpoint
+void CodeEditor::lineNumberAreaMousePressEvent( QMouseEvent* event )
+{
+	if( event->button() != Qt::LeftButton )
+	{
+		event->ignore();
+		return;
+	}
+
+	event->accept();
+	int block = cursorForPosition( QPoint( 0, event->y() ) ).blockNumber();
+	if( event->x() >= lineNumberArea->width() - foldAreaWidth() )
+	{
+		toggleFold( block );
+	}
+	else
+	{
+		toggleBreakpoint( block + 1 );
+	}
+}
+
+
+// The block after this one that is shown. Folded blocks have no lines, so
+// the next shown one is found by line number rather than by walking them.
+QTextBlock CodeEditor::nextVisible( QTextBlock const& block ) const
+{
+	QTextBlock next = block.next();
+	if( next.isValid() && ! next.isVisible() )
+	{
+		QTextBlock shown = document()->findBlockByLineNumber( block.firstLineNumber() + block.lineCount() );
+
+		// line counts not updated yet, walk after all
+		if( shown.isValid() && shown.blockNumber() > block.blockNumber() )
+		{
+			return shown;
+		}
+		while( next.isValid() && ! next.isVisible() )
+		{
+			next = next.next();
+		}
+	}
+	return next;
+}
+
+
+void CodeEditor::fold( int block )
+{
+	int end = m_structure->foldEnd( block );
+	QTextBlock header = document()->findBlockByNumber( block );
+	QTextBlock last = document()->findBlockByNumber( end );
+	if( end <= block + 1 || ! header.isValid() || ! last.isValid() )
+	{
+		return;
+	}
+
+	// keep the cursor out of what is hidden
+	int line = textCursor().blockNumber();
+	if( line > block && line < end )
+	{
+		QTextCursor cursor( header );
+		cursor.movePosition( QTextCursor::EndOfBlock );
+		setTextCursor( cursor );
+	}
+
+	// the closing line stays in view
+	for( QTextBlock hidden = header.next(); hidden.isValid() && hidden != last; hidden = hidden.next() )
+	{
+		hidden.setVisible( false );
+	}
+	relayout( header, last );
+}
+
+
+void CodeEditor::unfold( int block )
+{
+	QTextBlock header = document()->findBlockByNumber( block );
+	QTextBlock last = header.next();
+	if( ! last.isValid() || last.isVisible() )
+	{
+		return;
+	}
+
+	while( last.isValid() && ! last.isVisible() )
+	{
+		last.setVisible( true );
+		last = last.next();
+	}
+	relayout( header, last.isValid() ? last : document()->lastBlock() );
+}
+
+
+void CodeEditor::toggleFold( int block )
+{
+	QTextBlock next = document()->findBlockByNumber( block ).next();
+	if( next.isValid() && ! next.isVisible() )
+	{
+		unfold( block );
+	}
+	else
+	{
+		fold( block );
+	}
+}
+
+
+// Marking the blocks dirty has the layout drop hidden ones to no lines (and
+// no height) and give shown ones theirs back.
+void CodeEditor::relayout( QTextBlock const& first, QTextBlock const& last )
+{
+	int end = qMin( last.position() + last.length(), document()->characterCount() );
+	document()->markContentsDirty( first.position(), end - first.position() );
+
+	viewport()->update();
+	lineNumberArea->update();
+}
+
+
+void CodeEditor::contentsChange( int position, int removed, int added )
+{
+	Q_UNUSED( added );
+
+	// breakpoints stay with their lines as lines are added or removed above
+	int count = document()->blockCount();
+	int delta = count - m_blockCount;
+	m_blockCount = count;
+
+	if( delta != 0 && ! m_breakpoints.isEmpty() )
+	{
+		QTextBlock edited = document()->findBlock( position );
+
+		// lines inserted at the start of a line push it down with the rest
+		int from = edited.blockNumber() + ( removed == 0 && position == edited.position() ? 1 : 2 );
+
+		QSet<int> moved;
+		for( int line : m_breakpoints )
+		{
+			if( line < from )
+			{
+				moved.insert( line );
+			}
+			else if( delta > 0 || line >= from - delta )
+			{
+				moved.insert( line + delta );
+			}
+		}
+
+		if( moved != m_breakpoints )
+		{
+			m_breakpoints = moved;
+			lineNumberArea->update();
+			emit breakpointsChanged( breakpoints() );
+		}
+	}
+
+	// an edit that leaves a folded line with nothing open shows its lines again
+	QTextBlock block = document()->findBlock( position );
+	QTextBlock next = block.next();
+	if( next.isValid() && ! next.isVisible() && ! m_structure->isFoldable( block.blockNumber() ) )
+	{
+		unfold( block.blockNumber() );
+	}
+}
+
+
+void CodeEditor::setLineHeat( QHash<int, quint64> const& samples )
+{
+	m_heat.clear();
+
+	quint64 hottest = 0;
+	for( auto n : samples )
+	{
+		hottest = qMax( hottest, n );
+	}
+
+	for( auto it = samples.constBegin(); it != samples.constEnd(); ++it )
+	{
+		m_heat.insert( it.key(), qreal( it.value() ) / hottest );
+	}
+
+	lineNumberArea->update();
+}
+
+
+void CodeEditor::clearLineHeat( void )
+{
+	m_heat.clear();
+	lineNumberArea->update();
+}
+
+
+// Blocks covered by the selection (or the cursor's block), false when the
+// selection lies within a single block.
+bool CodeEditor::selectedBlocks( int* first, int* last ) const
 {
 	QTextCursor cursor( textCursor() );
-	if( ! cursor.hasSelection() )
+	int start = cursor.selectionStart();
+	int end = cursor.selectionEnd();
+
+	*first = document()->findBlock( start ).blockNumber();
+	*last = document()->findBlock( end ).blockNumber();
+	return *first != *last;
+}
+
+
+// Replaces blocks first..last with fn applied to each of their texts, as one
+// insertion: one undo step, one contentsChange, so the layout, highlighter
+// and gutter are updated once rather than per line. Several blocks are
+// selected afterwards; on a single line the cursor stays on the same text.
+void CodeEditor::transformBlocks( int first, int last, std::function<QString( QString const& )> const& fn )
+{
+	QTextCursor old = textCursor();
+	QTextBlock begin = document()->findBlockByNumber( first );
+	QTextBlock end = document()->findBlockByNumber( last );
+
+	QString before;
+	QString after;
+	for( QTextBlock block = begin; block.isValid(); block = block.next() )
 	{
-		return false;
+		QString text = block.text();
+		before += text;
+		after += fn( text );
+		if( block == end )
+		{
+			break;
+		}
+		before += QLatin1Char( '\n' );
+		after += QLatin1Char( '\n' );
 	}
 
-	int start = cursor.anchor();
-	int end = cursor.position();
+	int from = begin.position();
+
+	QTextCursor cursor( document() );
+	cursor.setPosition( from );
+	cursor.setPosition( end.position() + end.length() - 1, QTextCursor::KeepAnchor );
 
-	if( start > end )
+	if( after != before )
 	{
-		qSwap( start, end );
+		cursor.beginEditBlock();
+		cursor.insertText( after );
+		cursor.endEditBlock();
+	}
+
+	if( first != last )
+	{
+		// select from the start of the first block to the end of the last
+		cursor.setPosition( from );
+		cursor.setPosition( from + after.size(), QTextCursor::KeepAnchor );
+	}
+	else
+	{
+		// the line changed in one place, past the text both versions share;
+		// columns after it move by the change in length
+		int same = 0;
+		while( same < before.size() && same < after.size() && before.at( same ) == after.at( same ) )
+		{
+			++same;
+		}
+		int delta = after.size() - before.size();
+		auto map = [from, same, delta]( int position ) {
+			int column = position - from;
+			return from + ( column > same ? qMax( same, column + delta ) : column );
+		};
+
+		cursor.setPosition( map( old.anchor() ) );
+		cursor.setPosition( map( old.position() ), QTextCursor::KeepAnchor );
 	}
+	setTextCursor( cursor );
+}
 
-	// get count of blocks involved
-	cursor.setPosition( end, QTextCursor::MoveAnchor );
-	int eblock = cursor.block().blockNumber();
-	cursor.setPosition( start, QTextCursor::MoveAnchor );
-	int sblock = cursor.block().blockNumber();
 
-	// single line of text, not block indent mode
-	if( sblock == eblock )
+bool CodeEditor::increaseSelectionIndent( void )
+{
+	QTextCursor cursor( textCursor() );
+	if( isReadOnly() || ! cursor.hasSelection() )
 	{
+		return false;
+	}
+
+	int first, last;
+	if( ! selectedBlocks( &first, &last ) )
+	{
+		// single line of text, not block indent mode
 		cursor.insertText( QLatin1String( "\t" ) );
 		return true;
 	}
 
-	int bcount = eblock - sblock + 1;
+	transformBlocks( first, last, []( QString const& line ) -> QString {
+		return QLatin1Char( '\t' ) + line;
+	} );
+	return true;
+}
 
-	// begin inserting tabs
-	cursor.beginEditBlock();
-	for( int i = 0; i < bcount; ++i )
+
+bool CodeEditor::decreaseSelectionIndent( void )
+{
+	if( isReadOnly() )
 	{
-		cursor.movePosition( QTextCursor::StartOfBlock, QTextCursor::MoveAnchor );
-		cursor.insertText( QLatin1String( "\t" ) );
-		cursor.movePosition( QTextCursor::NextBlock, QTextCursor::MoveAnchor );
+		return false;
 	}
-	cursor.endEditBlock();
 
-	// reselect the indented block
-	cursor.setPosition( start, QTextCursor::MoveAnchor );
-	cursor.movePosition( QTextCursor::StartOfBlock, QTextCursor::MoveAnchor );
-	while( cursor.block().blockNumber() < eblock )
+	int first, last;
+	selectedBlocks( &first, &last );
+
+	// a tab, or up to a tab's worth of spaces
+	transformBlocks( first, last, []( QString const& line ) -> QString {
+		if( line.startsWith( QLatin1Char( '\t' ) ) )
+		{
+			return line.mid( 1 );
+		}
+
+		int n = 0;
+		while( n < indent_width && n < line.size() && line.at( n ) == QLatin1Char( ' ' ) )
+		{
+			++n;
+		}
+		return line.mid( n );
+	} );
+	return true;
+}
+
+
+bool CodeEditor::toggleSelectionComment( void )
+{
+	if( isReadOnly() )
 	{
-		cursor.movePosition( QTextCursor::NextBlock, QTextCursor::KeepAnchor );
+		return false;
 	}
-	cursor.movePosition( QTextCursor::EndOfBlock, QTextCursor::KeepAnchor );
 
-	setTextCursor( cursor );
+	int first, last;
+	selectedBlocks( &first, &last );
+
+	auto code = []( QString const& line ) {
+		int n = 0;
+		while( n < line.size() && line.at( n ).isSpace() )
+		{
+			++n;
+		}
+		return n;
+	};
+
+	// uncomment only when every line with something on it is a comment
+	bool commented = true;
+	bool blank = true;
+	QTextBlock end = document()->findBlockByNumber( last );
+	for( QTextBlock block = document()->findBlockByNumber( first ); block.isValid(); block = block.next() )
+	{
+		QString text = block.text();
+		int n = code( text );
+		if( n < text.size() )
+		{
+			blank = false;
+			if( text.midRef( n, 2 ) != QLatin1String( "--" ) )
+			{
+				commented = false;
+				break;
+			}
+		}
+		if( block == end )
+		{
+			break;
+		}
+	}
 
+	if( blank )
+	{
+		return false;
+	}
+
+	transformBlocks( first, last, [commented, &code]( QString const& line ) -> QString {
+		int n = code( line );
+		if( n == line.size() )
+		{
+			return line;
+		}
+
+		if( ! commented )
+		{
+			return line.left( n ) + QLatin1String( "-- " ) + line.mid( n );
+		}
+
+		int skip = line.midRef( n + 2, 1 ) == QLatin1String( " " ) ? 3 : 2;
+		return line.left( n ) + line.mid( n + skip );
+	} );
 	return true;
 }
 
+
+
+void CodeEditor::setErrorLine( int line, QString const& message )
+{
+	if( line == m_errorLine && message == m_errorMessage )
+	{
+		return;
+	}
+
+	m_errorLine = line;
+	m_errorMessage = message;
+	lineNumberArea->setToolTip( line > 0 ? tr( "Line %1: %2" ).arg( line ).arg( message ) : QString() );
+
+	highlightCurrentLine();
+	lineNumberArea->update();
+}
+
+
+void CodeEditor::setSearchMatches( QVector<SearchIndex::Match> const& matches )
+{
+	if( matches.isEmpty() && m_matches.isEmpty() )
+	{
+		return;
+	}
+
+	m_matches = matches;
+	highlightCurrentLine();
+}
+
+
+QList<int> CodeEditor::breakpoints( void ) const
+{
+	QList<int> lines = m_breakpoints.toList();
+	std::sort( lines.begin(), lines.end() );
+	return lines;
+}
+
+
+void CodeEditor::toggleBreakpoint( int line )
+{
+	if( line < 1 || line > blockCount() )
+	{
+		return;
+	}
+
+	if( ! m_breakpoints.remove( line ) )
+	{
+		m_breakpoints.insert( line );
+	}
+
+	lineNumberArea->update();
+	emit breakpointsChanged( breakpoints() );
+}
+
+
+void CodeEditor::clearBreakpoints( void )
+{
+	if( m_breakpoints.isEmpty() )
+	{
+		return;
+	}
+
+	m_breakpoints.clear();
+	lineNumberArea->update();
+	emit breakpointsChanged( QList<int>() );
+}
+
+
+void CodeEditor::setPausedLine( int line )
+{
+	if( line == m_pausedLine )
+	{
+		return;
+	}
+
+	m_pausedLine = line;
+	highlightCurrentLine();
+	lineNumberArea->update();
+}
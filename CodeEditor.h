@@ -1,31 +1,65 @@
 #ifndef CODEEDITOR_H
 #define CODEEDITOR_H
 
-#include <QTextEdit>
+#include <QPlainTextEdit>
 #include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QStaticText>
+#include <QVector>
 
+#include <functional>
+
+#include "SearchIndex.h"
+
+class QMouseEvent;
 class QPaintEvent;
 class QResizeEvent;
 class QSize;
+class QTextBlock;
 class QWidget;
 
 class LineNumberArea;
+class LuaStructure;
 
 
-class CodeEditor : public QTextEdit
+class CodeEditor : public QPlainTextEdit
 {
 	Q_OBJECT
 
 	public:
 
+		enum
+		{
+			// spaces removed by unindenting a line indented with spaces
+			indent_width = 4
+		};
+
 		CodeEditor(QWidget *parent = 0);
 
 		void lineNumberAreaPaintEvent(QPaintEvent *event);
+		void lineNumberAreaMousePressEvent( QMouseEvent* event );
 		int lineNumberAreaWidth();
 
+		LuaStructure* structure( void ) const;
+
+		// line numbers with a breakpoint, ascending
+		QList<int> breakpoints( void ) const;
+
+		// shade gutter lines by profiler samples (line number -> count)
+		void setLineHeat( QHash<int, quint64> const& samples );
+
 	signals:
 
 		void requestSave( void );
+		void requestFind( void );
+
+		// range of block numbers currently on screen
+		void visibleBlocksChanged( int first, int last );
+
+		// toggled in the gutter (or F9), or moved by edits above them
+		void breakpointsChanged( QList<int> const& lines );
 
 	protected:
 
@@ -33,21 +67,73 @@ class CodeEditor : public QTextEdit
 		virtual void keyPressEvent(QKeyEvent *e) Q_DECL_OVERRIDE;
 		virtual void changeEvent(QEvent* e ) Q_DECL_OVERRIDE;
 
-		QTextBlock findFirstVisibleBlock( void );
+		void updateVisibleBlocks( void );
+
+		bool selectedBlocks( int* first, int* last ) const;
+		void transformBlocks( int first, int last, std::function<QString( QString const& )> const& fn );
 
 	public slots:
 
+		// indent, unindent (Shift+Tab) and comment toggling (Ctrl+/) of the
+		// selected lines, each applied to all of them in one edit; false
+		// (and no edit) while read-only
 		bool increaseSelectionIndent( void );
+		bool decreaseSelectionIndent( void );
+		bool toggleSelectionComment( void );
+		void clearLineHeat( void );
+
+		// underline a line with a compile error, 0 clears it
+		void setErrorLine( int line, QString const& message );
+
+		// highlight these (sorted by position), where they are on screen
+		void setSearchMatches( QVector<SearchIndex::Match> const& matches );
+
+		// hide the lines inside the block opened on line (block number), up to
+		// the line closing it, or show them again
+		void fold( int block );
+		void unfold( int block );
+		void toggleFold( int block );
+
+		void toggleBreakpoint( int line );
+		void clearBreakpoints( void );
+
+		// mark the line the debugger is paused at, 0 for none
+		void setPausedLine( int line );
 
 	private slots:
 
 		void updateLineNumberAreaWidth(int newBlockCount);
 		void highlightCurrentLine();
-		void updateLineNumberArea();
+		void updateLineNumberArea( QRect const& rect, int dy );
+		void contentsChange( int position, int removed, int added );
 
 	private:
 
+		int foldAreaWidth( void ) const;
+		QTextBlock nextVisible( QTextBlock const& block ) const;
+		void relayout( QTextBlock const& first, QTextBlock const& last );
+
 		QWidget *lineNumberArea;
+		LuaStructure* m_structure;
+
+		int m_visibleFirst;
+		int m_visibleLast;
+
+		// prepared line numbers, dropped when the font changes
+		QHash<int, QStaticText> m_numbers;
+
+		// line number -> share of the hottest line
+		QHash<int, qreal> m_heat;
+
+		// 1 based, 0 for none
+		QVector<SearchIndex::Match> m_matches;
+
+		int m_errorLine;
+		QString m_errorMessage;
+
+		QSet<int> m_breakpoints;
+		int m_pausedLine;
+		int m_blockCount;		// as of the last contentsChange
 };
 
 
@@ -67,6 +153,10 @@ class LineNumberArea : public QWidget
 			codeEditor->lineNumberAreaPaintEvent(event);
 		}
 
+		void mousePressEvent( QMouseEvent* event ) Q_DECL_OVERRIDE {
+			codeEditor->lineNumberAreaMousePressEvent( event );
+		}
+
 	private:
 		CodeEditor *codeEditor;
 };
@@ -0,0 +1,427 @@
+#include "EditJournal.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#endif
+
+namespace
+{
+	enum
+	{
+		// compact once the edits logged exceed the document or this, whichever is more
+		compact_bytes = 4 << 20
+	};
+
+	// record types
+	char const header_record = 'H';		// filename, size and mtime of the base file
+	char const snapshot_record = 'B';	// the whole text, replaces the base
+	char const edit_record = 'E';		// position, removed, added text
+
+	QString journalDir( void )
+	{
+		return QStandardPaths::writableLocation( QStandardPaths::AppDataLocation ) + QLatin1String( "/journal" );
+	}
+
+	// type, payload length, checksum, payload
+	QByteArray record( char type, QByteArray const& payload )
+	{
+		QByteArray out;
+		QDataStream s( &out, QIODevice::WriteOnly );
+		s << quint8( type ) << quint32( payload.size() ) << qChecksum( payload.constData(), uint( payload.size() ) );
+		s.writeRawData( payload.constData(), payload.size() );
+		return out;
+	}
+
+	QByteArray header( QString const& filename )
+	{
+		QByteArray payload;
+		QDataStream s( &payload, QIODevice::WriteOnly );
+
+		QFileInfo info( filename );
+		bool exists = ! filename.isEmpty() && info.exists();
+		s << filename << qint64( exists ? info.size() : -1 ) << qint64( exists ? info.lastModified().toMSecsSinceEpoch() : -1 );
+		return record( header_record, payload );
+	}
+}
+
+
+struct EditJournal::pi_Worker
+{
+	struct Job
+	{
+		enum Type
+		{
+			Append,		// data to path
+			Rewrite,	// path becomes data, then a snapshot of text if not null
+			Remove
+		};
+
+		Type type;
+		QString path;
+		QByteArray data;
+		QString text;
+	};
+
+	pi_Worker( void ) :
+		quit( false )
+	{
+		thread = std::thread( &pi_Worker::run, this );
+	}
+
+	~pi_Worker( void )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			quit = true;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	void submit( Job const& job )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+
+			// consecutive appends go out in one write
+			if( job.type == Job::Append && ! jobs.isEmpty() && jobs.last().type == Job::Append && jobs.last().path == job.path )
+			{
+				jobs.last().data += job.data;
+			}
+			else
+			{
+				jobs.append( job );
+			}
+		}
+		wake.notify_all();
+	}
+
+	void execute( Job const& job )
+	{
+		if( job.type != Job::Append || file.fileName() != job.path )
+		{
+			file.close();
+		}
+
+		switch( job.type )
+		{
+			case Job::Append:
+				if( ! file.isOpen() )
+				{
+					QDir().mkpath( QFileInfo( job.path ).absolutePath() );
+					file.setFileName( job.path );
+					file.open( QIODevice::WriteOnly | QIODevice::Append );
+				}
+				// flushed to the OS, which is what outlives a crashed process
+				file.write( job.data );
+				file.flush();
+				break;
+
+			case Job::Rewrite:
+			{
+				QDir().mkpath( QFileInfo( job.path ).absolutePath() );
+				QSaveFile out( job.path );
+				if( out.open( QIODevice::WriteOnly ) )
+				{
+					out.write( job.data );
+					if( ! job.text.isNull() )
+					{
+						out.write( record( snapshot_record, job.text.toUtf8() ) );
+					}
+					out.commit();
+				}
+				break;
+			}
+
+			case Job::Remove:
+				QFile::remove( job.path );
+				break;
+		}
+	}
+
+	void run( void )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		for( ;; )
+		{
+			// everything queued is written before quitting
+			wake.wait( lock, [this]{ return quit || ! jobs.isEmpty(); } );
+			if( jobs.isEmpty() )
+			{
+				break;
+			}
+
+			Job job = jobs.takeFirst();
+			lock.unlock();
+			execute( job );
+			lock.lock();
+		}
+
+		file.close();
+	}
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	QList<Job> jobs;		// under mutex
+	bool quit;
+
+	QFile file;				// worker thread, journal open for appending
+};
+
+
+EditJournal::EditJournal( QTextDocument* document ) :
+	QObject( document ),
+	m_document( document ),
+	m_worker( new pi_Worker ),
+	m_path( path( QString() ) ),
+	m_enabled( true ),
+	m_recording( true ),
+	m_started( false ),
+	m_revision( document->revision() ),
+	m_logged( 0 )
+{
+	connect( document, &QTextDocument::contentsChange, this, &EditJournal::contentsChange );
+}
+
+
+EditJournal::~EditJournal( void )
+{
+	delete m_worker;
+}
+
+
+void EditJournal::setRecording( bool on )
+{
+	m_recording = on;
+	m_revision = m_document->revision();
+}
+
+
+void EditJournal::setEnabled( bool on )
+{
+	m_enabled = on;
+}
+
+
+bool EditJournal::isEnabled( void ) const
+{
+	return m_enabled;
+}
+
+
+void EditJournal::reset( QString const& filename )
+{
+	// only a journal this session wrote; one left by an earlier session
+	// for the same file is still to be offered for recovery
+	if( m_started )
+	{
+		pi_Worker::Job job;
+		job.type = pi_Worker::Job::Remove;
+		job.path = m_path;
+		m_worker->submit( job );
+	}
+
+	m_filename = filename;
+	m_path = path( filename );
+	m_started = false;
+	m_revision = m_document->revision();
+	m_logged = 0;
+}
+
+
+void EditJournal::compact( void )
+{
+	if( ! m_enabled )
+	{
+		return;
+	}
+	begin( m_document->toPlainText() );
+}
+
+
+void EditJournal::begin( QString const& base )
+{
+	pi_Worker::Job job;
+	job.type = pi_Worker::Job::Rewrite;
+	job.path = m_path;
+	job.data = header( m_filename );
+	job.text = base;
+	m_worker->submit( job );
+
+	m_started = true;
+	m_logged = 0;
+}
+
+
+void EditJournal::contentsChange( int position, int removed, int added )
+{
+	// format changes are reported too, they leave the revision alone
+	if( ! m_enabled || ! m_recording || m_document->revision() == m_revision )
+	{
+		return;
+	}
+	m_revision = m_document->revision();
+
+	if( ! m_started )
+	{
+		// until now the document was the file on disk
+		begin( QString() );
+	}
+
+	int end = qMin( position + added, m_document->characterCount() - 1 );
+
+	QString text;
+	if( end > position )
+	{
+		QTextCursor cursor( m_document );
+		cursor.setPosition( position );
+		cursor.setPosition( end, QTextCursor::KeepAnchor );
+		text = cursor.selectedText();
+		text.replace( QChar::ParagraphSeparator, QLatin1Char( '\n' ) );
+	}
+
+	QByteArray payload;
+	{
+		QDataStream s( &payload, QIODevice::WriteOnly );
+		s << qint32( position ) << qint32( removed );
+	}
+	payload += text.toUtf8();
+
+	pi_Worker::Job job;
+	job.type = pi_Worker::Job::Append;
+	job.path = m_path;
+	job.data = record( edit_record, payload );
+	m_worker->submit( job );
+
+	m_logged += job.data.size();
+	if( m_logged > qMax<qint64>( compact_bytes, m_document->characterCount() ) )
+	{
+		compact();
+	}
+}
+
+
+QString EditJournal::path( QString const& filename )
+{
+	QByteArray key = filename.isEmpty() ? QByteArray( "untitled" ) : QFileInfo( filename ).absoluteFilePath().toUtf8();
+	return journalDir() + QLatin1Char( '/' ) + QString::fromLatin1( QCryptographicHash::hash( key, QCryptographicHash::Sha1 ).toHex() ) + QLatin1String( ".journal" );
+}
+
+
+QStringList EditJournal::pending( void )
+{
+	QStringList out;
+	QDir dir( journalDir() );
+	for( auto const& info : dir.entryInfoList( QStringList() << QLatin1String( "*.journal" ), QDir::Files, QDir::Time ) )
+	{
+		out << info.absoluteFilePath();
+	}
+	return out;
+}
+
+
+bool EditJournal::replay( QString const& journal, QString* filename, QString* text )
+{
+	QFile file( journal );
+	if( ! file.open( QIODevice::ReadOnly ) )
+	{
+		return false;
+	}
+
+	QDataStream in( &file );
+	bool based = false;
+	bool first = true;
+
+	for( ;; )
+	{
+		quint8 type;
+		quint32 length;
+		quint16 sum;
+		in >> type >> length >> sum;
+		if( in.status() != QDataStream::Ok || length > quint32( file.size() ) )
+		{
+			break;
+		}
+
+		QByteArray payload( int( length ), Qt::Uninitialized );
+		if( in.readRawData( payload.data(), payload.size() ) != payload.size() ||
+			qChecksum( payload.constData(), uint( payload.size() ) ) != sum )
+		{
+			break;		// torn by the crash
+		}
+
+		if( first != ( type == header_record ) )
+		{
+			break;
+		}
+		first = false;
+
+		if( type == header_record )
+		{
+			qint64 size, stamp;
+			QDataStream s( payload );
+			s >> *filename >> size >> stamp;
+
+			// the file it started from, if it is still as it was
+			text->clear();
+			if( size < 0 )
+			{
+				based = true;
+			}
+			else
+			{
+				QFileInfo info( *filename );
+				QFile base( *filename );
+				if( info.size() == size && info.lastModified().toMSecsSinceEpoch() == stamp && base.open( QIODevice::ReadOnly ) )
+				{
+					// decoded as LuaForm::open does, and with line breaks as the
+					// document has them: edit positions count one per break
+					*text = QString::fromLocal8Bit( base.readAll() );
+					text->replace( QLatin1String( "\r\n" ), QLatin1String( "\n" ) );
+					text->replace( QLatin1Char( '\r' ), QLatin1Char( '\n' ) );
+					based = true;
+				}
+			}
+		}
+		else if( type == snapshot_record )
+		{
+			*text = QString::fromUtf8( payload );
+			based = true;
+		}
+		else if( type == edit_record && based && payload.size() >= 8 )
+		{
+			qint32 position, removed;
+			QDataStream s( payload );
+			s >> position >> removed;
+			text->replace( position, removed, QString::fromUtf8( payload.constData() + 8, payload.size() - 8 ) );
+		}
+	}
+
+	return based && ! first;
+}
+
+
+void EditJournal::discard( QString const& journal )
+{
+	QFile::remove( journal );
+}
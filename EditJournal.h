@@ -0,0 +1,76 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QTextDocument;
+
+// Append-only record of the edits made to a document since it last matched
+// its file on disk, kept so unsaved work survives a crash.
+//
+// Each contentsChange is appended as a delta (position, characters removed,
+// text added) by a background thread, so the cost of an edit is the size of
+// the edit. Once the deltas outgrow the document the journal is compacted:
+// rewritten as a snapshot of the text, again in the background. Records are
+// checksummed; replay stops at a torn tail.
+class EditJournal : public QObject
+{
+	Q_OBJECT
+
+	struct pi_Worker;
+
+	public:
+
+		explicit EditJournal( QTextDocument* document );
+		~EditJournal( void );
+
+		// the document now matches filename on disk (opened or saved), drop
+		// the journal kept so far; empty for an untitled document. A journal
+		// already there for filename is left to be recovered or discarded.
+		void reset( QString const& filename );
+
+		// record the whole text, for a document that does not match the disk
+		void compact( void );
+
+		// while off, edits are not recorded (e.g. loading a file)
+		void setRecording( bool on );
+
+		// no journal at all, nothing is written or removed
+		void setEnabled( bool on );
+		bool isEnabled( void ) const;
+
+		// where the journal for filename is kept
+		static QString path( QString const& filename );
+
+		// journals left behind by earlier sessions, newest first
+		static QStringList pending( void );
+
+		// rebuild the text a journal was kept for; false if the file it was
+		// based on has changed since and it has no snapshot of its own
+		static bool replay( QString const& journal, QString* filename, QString* text );
+
+		static void discard( QString const& journal );
+
+	private slots:
+
+		void contentsChange( int position, int removed, int added );
+
+	private:
+
+		void begin( QString const& base );
+
+		QTextDocument* m_document;
+		pi_Worker* m_worker;
+
+		QString m_filename;
+		QString m_path;
+		bool m_enabled;
+		bool m_recording;
+		bool m_started;		// header written since the last reset
+		int m_revision;		// of the last edit recorded
+		qint64 m_logged;	// bytes of edits since the header or snapshot
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,245 @@
+#include "FileWriter.h"
+
+#include <QFile>
+#include <QList>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QTextCodec>
+#include <QTextEncoder>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#endif
+
+namespace
+{
+	enum
+	{
+		// characters encoded (or bytes copied) at a time
+		block_size = 1 << 20
+	};
+}
+
+
+struct FileWriter::pi_Worker
+{
+	struct Job
+	{
+		QString filename;
+		QString text;
+		QString source;		// copy from this file instead, when set
+		quint64 tag;
+	};
+
+	struct Result
+	{
+		QString filename;
+		QString error;		// empty on success
+		quint64 tag;
+	};
+
+	pi_Worker( FileWriter* parent ) :
+		owner( parent ),
+		busy( false ),
+		quit( false )
+	{
+		thread = std::thread( &pi_Worker::run, this );
+	}
+
+	~pi_Worker( void )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			quit = true;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	void submit( Job const& job )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+
+			bool replaced = false;
+			for( auto& queued : jobs )
+			{
+				if( queued.filename == job.filename )
+				{
+					queued = job;
+					replaced = true;
+					break;
+				}
+			}
+
+			if( ! replaced )
+			{
+				jobs.append( job );
+			}
+		}
+		wake.notify_all();
+	}
+
+	static QString write( Job const& job )
+	{
+		QSaveFile file( job.filename );
+		if( ! file.open( QIODevice::WriteOnly ) )
+		{
+			return file.errorString();
+		}
+
+		if( job.source.isNull() )
+		{
+			QScopedPointer<QTextEncoder> encoder( QTextCodec::codecForLocale()->makeEncoder() );
+			for( int i = 0; i < job.text.size(); i += block_size )
+			{
+				// the encoder keeps surrogate pairs split across blocks together
+				int n = qMin<int>( block_size, job.text.size() - i );
+				if( file.write( encoder->fromUnicode( job.text.constData() + i, n ) ) < 0 )
+				{
+					break;
+				}
+			}
+		}
+		else
+		{
+			QFile in( job.source );
+			if( ! in.open( QIODevice::ReadOnly ) )
+			{
+				file.cancelWriting();
+				return in.errorString();
+			}
+
+			while( ! in.atEnd() )
+			{
+				QByteArray data = in.read( block_size );
+				if( data.isEmpty() || file.write( data ) < 0 )
+				{
+					file.cancelWriting();
+					return in.error() != QFile::NoError ? in.errorString() : file.errorString();
+				}
+			}
+		}
+
+		// syncs to disk, then renames over the target
+		if( ! file.commit() )
+		{
+			return file.errorString();
+		}
+		return QString();
+	}
+
+	void run( void )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		for( ;; )
+		{
+			// drain the queue even when asked to quit, nothing is dropped
+			wake.wait( lock, [this]{ return quit || ! jobs.isEmpty(); } );
+			if( jobs.isEmpty() )
+			{
+				break;
+			}
+
+			Job job = jobs.takeFirst();
+			busy = true;
+			lock.unlock();
+
+			Result result;
+			result.filename = job.filename;
+			result.tag = job.tag;
+			result.error = write( job );
+			if( ! result.error.isNull() && result.error.isEmpty() )
+			{
+				result.error = QStringLiteral( "unknown error" );
+			}
+
+			lock.lock();
+			busy = false;
+			results.append( result );
+			if( results.size() == 1 )
+			{
+				QMetaObject::invokeMethod( owner, "deliver", Qt::QueuedConnection );
+			}
+		}
+	}
+
+	FileWriter* owner;
+	std::thread thread;
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+
+	// under mutex
+	QList<Job> jobs;
+	QList<Result> results;
+	bool busy;
+	bool quit;
+};
+
+
+FileWriter::FileWriter( QObject* parent ) :
+	QObject( parent ),
+	m_worker( new pi_Worker( this ) )
+{
+}
+
+
+FileWriter::~FileWriter( void )
+{
+	delete m_worker;
+}
+
+
+void FileWriter::write( QString const& filename, QString const& text, quint64 tag )
+{
+	pi_Worker::Job job;
+	job.filename = filename;
+	job.text = text;
+	job.tag = tag;
+	m_worker->submit( job );
+}
+
+
+void FileWriter::copy( QString const& from, QString const& to, quint64 tag )
+{
+	pi_Worker::Job job;
+	job.filename = to;
+	job.source = from;
+	job.tag = tag;
+	m_worker->submit( job );
+}
+
+
+bool FileWriter::isBusy( void ) const
+{
+	std::lock_guard<std::mutex> lock( m_worker->mutex );
+	return m_worker->busy || ! m_worker->jobs.isEmpty();
+}
+
+
+void FileWriter::deliver( void )
+{
+	QList<pi_Worker::Result> results;
+	{
+		std::lock_guard<std::mutex> lock( m_worker->mutex );
+		results.swap( m_worker->results );
+	}
+
+	for( auto const& r : results )
+	{
+		if( r.error.isEmpty() )
+		{
+			emit written( r.filename, r.tag );
+		}
+		else
+		{
+			emit failed( r.filename, r.error );
+		}
+	}
+}
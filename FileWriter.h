@@ -0,0 +1,48 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QObject>
+#include <QString>
+
+// Writes files on a background thread, through QSaveFile: into a temporary
+// file beside the target, synced to disk and renamed over it, so a crash
+// mid-write leaves the old file intact.
+//
+// A request for a file that is still waiting its turn replaces the queued
+// one, so saving repeatedly only writes the latest text. Completion is
+// signalled (queued) on the thread that owns the writer.
+class FileWriter : public QObject
+{
+	Q_OBJECT
+
+	struct pi_Worker;
+
+	public:
+
+		explicit FileWriter( QObject* parent = 0 );
+
+		// finishes everything queued first
+		~FileWriter( void );
+
+		// text is encoded with the locale codec on the worker; tag comes back with written()
+		void write( QString const& filename, QString const& text, quint64 tag = 0 );
+
+		void copy( QString const& from, QString const& to, quint64 tag = 0 );
+
+		bool isBusy( void ) const;
+
+	signals:
+
+		void written( QString const& filename, quint64 tag );
+		void failed( QString const& filename, QString const& error );
+
+	private slots:
+
+		void deliver( void );
+
+	private:
+
+		pi_Worker* m_worker;
+};
+
+#endif // FILEWRITER_H
@@ -0,0 +1,281 @@
+#include "FindBar.h"
+
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QTextCursor>
+#include <QTimer>
+#include <QToolButton>
+
+#include <algorithm>
+
+#include "CodeEditor.h"
+
+
+FindBar::FindBar( CodeEditor* editor, QWidget* parent ) :
+	QWidget( parent ),
+	m_editor( editor ),
+	m_index( new SearchIndex( editor->document() ) ),
+	m_current( -1 )
+{
+	m_find = new QLineEdit;
+	m_find->setPlaceholderText( tr( "Find" ) );
+	m_replace = new QLineEdit;
+	m_replace->setPlaceholderText( tr( "Replace with" ) );
+	m_case = new QCheckBox( tr( "Match case" ) );
+	m_count = new QLabel;
+
+	QToolButton* previous = new QToolButton;
+	previous->setText( tr( "Previous" ) );
+	QToolButton* next = new QToolButton;
+	next->setText( tr( "Next" ) );
+	QToolButton* one = new QToolButton;
+	one->setText( tr( "Replace" ) );
+	QToolButton* all = new QToolButton;
+	all->setText( tr( "Replace All" ) );
+	QToolButton* close = new QToolButton;
+	close->setText( tr( "Close" ) );
+
+	QHBoxLayout* layout = new QHBoxLayout( this );
+	layout->setContentsMargins( 0, 2, 0, 2 );
+	layout->addWidget( m_find, 2 );
+	layout->addWidget( previous );
+	layout->addWidget( next );
+	layout->addWidget( m_replace, 1 );
+	layout->addWidget( one );
+	layout->addWidget( all );
+	layout->addWidget( m_case );
+	layout->addWidget( m_count );
+	layout->addWidget( close );
+
+	m_timer = new QTimer( this );
+	m_timer->setSingleShot( true );
+	m_timer->setInterval( 50 );
+	connect( m_timer, &QTimer::timeout, this, &FindBar::refresh );
+
+	connect( m_find, &QLineEdit::textEdited, this, &FindBar::search );
+	connect( m_find, &QLineEdit::returnPressed, this, &FindBar::findNext );
+	connect( m_replace, &QLineEdit::returnPressed, this, &FindBar::replace );
+	connect( m_case, &QCheckBox::toggled, this, &FindBar::search );
+	connect( previous, &QToolButton::clicked, this, &FindBar::findPrevious );
+	connect( next, &QToolButton::clicked, this, &FindBar::findNext );
+	connect( one, &QToolButton::clicked, this, &FindBar::replace );
+	connect( all, &QToolButton::clicked, this, &FindBar::replaceAll );
+	connect( close, &QToolButton::clicked, this, &FindBar::hide );
+
+	connect( editor->document(), &QTextDocument::contentsChanged, this, &FindBar::documentChanged );
+}
+
+
+void FindBar::activate( void )
+{
+	QString selected = m_editor->textCursor().selectedText();
+	if( ! selected.isEmpty() && ! selected.contains( QChar::ParagraphSeparator ) )
+	{
+		m_find->setText( selected );
+	}
+
+	show();
+	m_find->setFocus();
+	m_find->selectAll();
+	search();
+}
+
+
+Qt::CaseSensitivity FindBar::sensitivity( void ) const
+{
+	return m_case->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive;
+}
+
+
+// index of the first match at or after position, wrapping to the first
+int FindBar::following( int position ) const
+{
+	auto it = std::lower_bound( m_matches.constBegin(), m_matches.constEnd(), position,
+		[]( SearchIndex::Match const& m, int pos ){ return m.position < pos; } );
+	return it == m_matches.constEnd() ? 0 : int( it - m_matches.constBegin() );
+}
+
+
+// find afresh and select the first match from the start of the selection on
+void FindBar::search( void )
+{
+	refresh();
+
+	if( ! m_matches.isEmpty() )
+	{
+		select( following( m_editor->textCursor().selectionStart() ) );
+	}
+}
+
+
+// find afresh, leaving the editor's cursor where it is
+void FindBar::refresh( void )
+{
+	m_timer->stop();
+
+	m_matches = m_index->find( m_find->text(), sensitivity() );
+	m_editor->setSearchMatches( m_matches );
+
+	// the current match is kept only while it is still what is selected
+	QTextCursor cursor = m_editor->textCursor();
+	m_current = -1;
+	if( cursor.hasSelection() && ! m_matches.isEmpty() )
+	{
+		int i = following( cursor.selectionStart() );
+		SearchIndex::Match const& m = m_matches.at( i );
+		if( m.position == cursor.selectionStart() && m.position + m.length == cursor.selectionEnd() )
+		{
+			m_current = i;
+		}
+	}
+
+	updateCount();
+}
+
+
+void FindBar::updateCount( void )
+{
+	if( m_current >= 0 )
+	{
+		m_count->setText( tr( "%1 of %2" ).arg( m_current + 1 ).arg( m_matches.size() ) );
+	}
+	else if( ! m_matches.isEmpty() )
+	{
+		m_count->setText( tr( "%1 matches" ).arg( m_matches.size() ) );
+	}
+	else
+	{
+		m_count->setText( m_find->text().isEmpty() ? QString() : tr( "No matches" ) );
+	}
+}
+
+
+void FindBar::documentChanged( void )
+{
+	if( isVisible() && ! m_find->text().isEmpty() )
+	{
+		m_timer->start();
+	}
+}
+
+
+void FindBar::select( int index )
+{
+	m_current = index;
+
+	SearchIndex::Match const& m = m_matches.at( index );
+	QTextCursor cursor = m_editor->textCursor();
+	cursor.setPosition( m.position );
+	cursor.setPosition( m.position + m.length, QTextCursor::KeepAnchor );
+	m_editor->setTextCursor( cursor );
+
+	updateCount();
+}
+
+
+void FindBar::findNext( void )
+{
+	if( m_timer->isActive() )
+	{
+		refresh();
+	}
+
+	if( m_matches.isEmpty() )
+	{
+		return;
+	}
+
+	// from the caret when the selection is not a match (e.g. after typing)
+	if( m_current < 0 )
+	{
+		select( following( m_editor->textCursor().selectionStart() ) );
+	}
+	else
+	{
+		select( ( m_current + 1 ) % m_matches.size() );
+	}
+}
+
+
+void FindBar::findPrevious( void )
+{
+	if( m_timer->isActive() )
+	{
+		refresh();
+	}
+
+	if( m_matches.isEmpty() )
+	{
+		return;
+	}
+
+	int from = m_current >= 0 ? m_current : following( m_editor->textCursor().selectionStart() );
+	select( ( from + m_matches.size() - 1 ) % m_matches.size() );
+}
+
+
+void FindBar::replace( void )
+{
+	if( m_editor->isReadOnly() )
+	{
+		return;
+	}
+
+	if( m_current < 0 || m_timer->isActive() )
+	{
+		search();
+		return;
+	}
+
+	// only when the current match is still what is selected
+	SearchIndex::Match const& m = m_matches.at( m_current );
+	QTextCursor cursor = m_editor->textCursor();
+	if( cursor.selectionStart() == m.position && cursor.selectionEnd() == m.position + m.length )
+	{
+		cursor.insertText( m_replace->text() );
+		m_editor->setTextCursor( cursor );
+	}
+
+	search();
+}
+
+
+void FindBar::replaceAll( void )
+{
+	if( m_editor->isReadOnly() )
+	{
+		return;
+	}
+
+	int n = m_index->replaceAll( m_find->text(), m_replace->text(), sensitivity() );
+	search();
+	m_count->setText( tr( "%1 replaced" ).arg( n ) );
+}
+
+
+void FindBar::keyPressEvent( QKeyEvent* e )
+{
+	if( e->key() == Qt::Key_Escape )
+	{
+		e->accept();
+		hide();
+		m_editor->setFocus();
+		return;
+	}
+
+	QWidget::keyPressEvent( e );
+}
+
+
+void FindBar::hideEvent( QHideEvent* e )
+{
+	m_timer->stop();
+	m_matches.clear();
+	m_current = -1;
+	m_editor->setSearchMatches( m_matches );
+
+	QWidget::hideEvent( e );
+}
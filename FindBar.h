@@ -0,0 +1,70 @@
+#ifndef FINDBAR_H
+#define FINDBAR_H
+
+#include <QWidget>
+#include <QVector>
+
+#include "SearchIndex.h"
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QTimer;
+
+class CodeEditor;
+
+// Incremental find and replace under a CodeEditor. Every match is found
+// through the document's SearchIndex as the query is typed and handed to the
+// editor to highlight; the editor's selection is the current one.
+class FindBar : public QWidget
+{
+	Q_OBJECT
+
+	public:
+
+		explicit FindBar( CodeEditor* editor, QWidget* parent = 0 );
+
+	public slots:
+
+		// show and focus, starting from the editor's selection
+		void activate( void );
+
+		void findNext( void );
+		void findPrevious( void );
+		void replace( void );
+		void replaceAll( void );
+
+	protected:
+
+		void keyPressEvent( QKeyEvent* e ) Q_DECL_OVERRIDE;
+		void hideEvent( QHideEvent* e ) Q_DECL_OVERRIDE;
+
+	private slots:
+
+		void search( void );
+		void refresh( void );
+		void documentChanged( void );
+
+	private:
+
+		Qt::CaseSensitivity sensitivity( void ) const;
+		int following( int position ) const;
+		void select( int index );
+		void updateCount( void );
+
+		CodeEditor* m_editor;
+		SearchIndex* m_index;
+
+		QLineEdit* m_find;
+		QLineEdit* m_replace;
+		QCheckBox* m_case;
+		QLabel* m_count;
+
+		// coalesces re-searching after edits, which never moves the cursor
+		QTimer* m_timer;
+
+		QVector<SearchIndex::Match> m_matches;
+		int m_current;
+};
+
+#endif // FINDBAR_H
@@ -0,0 +1,79 @@
+#include "LargeFileView.h"
+#include "MappedFile.h"
+
+#include <QtWidgets>
+
+
+LargeFileView::LargeFileView( QWidget* parent ) :
+	LineView( parent )
+{
+	// copying more than this many lines to the clipboard is refused
+	setCopyLimit( 100000 );
+
+	m_file = new MappedFile( this );
+	connect( m_file, &MappedFile::indexed, this, &LargeFileView::updateScrollBars );
+	connect( m_file, &MappedFile::finished, [this]{
+		emit indexed( m_file->lineCount() );
+	} );
+
+	updateScrollBars();
+}
+
+
+LargeFileView::~LargeFileView( void )
+{
+}
+
+
+bool LargeFileView::open( QString const& filename )
+{
+	m_anchor = m_cursor = -1;
+
+	bool ok = m_file->open( filename );
+
+	verticalScrollBar()->setValue( 0 );
+	horizontalScrollBar()->setValue( 0 );
+	updateScrollBars();
+
+	return ok;
+}
+
+
+void LargeFileView::close( void )
+{
+	m_file->close();
+	m_anchor = m_cursor = -1;
+
+	updateScrollBars();
+}
+
+
+MappedFile* LargeFileView::file( void ) const
+{
+	return m_file;
+}
+
+
+int LargeFileView::lineCount( void ) const
+{
+	return m_file->lineCount();
+}
+
+
+QString LargeFileView::line( int n ) const
+{
+	return QString::fromLocal8Bit( m_file->line( n ) );
+}
+
+
+qint64 LargeFileView::longestLine( void ) const
+{
+	return m_file->longestLine();
+}
+
+
+int LargeFileView::gutterWidth( void ) const
+{
+	int digits = QString::number( qMax( 1, m_file->lineCount() ) ).size();
+	return 8 + fontMetrics().width( QLatin1Char( '9' ) ) * digits;
+}
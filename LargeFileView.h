@@ -0,0 +1,46 @@
+#ifndef LARGEFILEVIEW_H
+#define LARGEFILEVIEW_H
+
+#include "LineView.h"
+
+class MappedFile;
+
+
+// Read-only viewer for scripts too large to load into a text document.
+//
+// The file is memory mapped and only the lines inside the viewport are
+// decoded when painting; the line index fills in while scrolling is
+// already possible.
+class LargeFileView : public LineView
+{
+	Q_OBJECT
+
+	public:
+
+		explicit LargeFileView( QWidget* parent = 0 );
+		~LargeFileView( void );
+
+		bool open( QString const& filename );
+		void close( void );
+
+		MappedFile* file( void ) const;
+
+		int lineCount( void ) const Q_DECL_OVERRIDE;
+		QString line( int n ) const Q_DECL_OVERRIDE;
+
+	signals:
+
+		// the line index has been completed
+		void indexed( int lines );
+
+	protected:
+
+		qint64 longestLine( void ) const Q_DECL_OVERRIDE;
+		int gutterWidth( void ) const Q_DECL_OVERRIDE;
+
+	private:
+
+		MappedFile* m_file;
+};
+
+#endif // LARGEFILEVIEW_H
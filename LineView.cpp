@@ -0,0 +1,257 @@
+#include "LineView.h"
+
+#include <QtWidgets>
+
+#include <climits>
+
+
+LineView::LineView( QWidget* parent ) :
+	QAbstractScrollArea( parent ),
+	m_anchor( -1 ),
+	m_cursor( -1 ),
+	m_tabStop( 0 ),
+	m_copyLimit( INT_MAX )
+{
+	setFocusPolicy( Qt::StrongFocus );
+	viewport()->setCursor( Qt::IBeamCursor );
+	viewport()->setAutoFillBackground( true );
+	viewport()->setBackgroundRole( QPalette::Base );
+}
+
+
+void LineView::setTabStopWidth( int width )
+{
+	m_tabStop = width;
+	viewport()->update();
+}
+
+
+void LineView::setCopyLimit( int lines )
+{
+	m_copyLimit = lines;
+}
+
+
+int LineView::gutterWidth( void ) const
+{
+	return 0;
+}
+
+
+void LineView::selectAll( void )
+{
+	int lines = lineCount();
+	if( lines > 0 )
+	{
+		m_anchor = 0;
+		m_cursor = lines - 1;
+		viewport()->update();
+	}
+}
+
+
+void LineView::copy( void )
+{
+	if( m_anchor < 0 )
+	{
+		return;
+	}
+
+	int first = qMin( m_anchor, m_cursor );
+	int last = qMax( m_anchor, m_cursor );
+	if( last - first >= m_copyLimit )
+	{
+		last = first + m_copyLimit - 1;
+	}
+
+	QStringList lines;
+	for( int i = first; i <= last; ++i )
+	{
+		lines << line( i );
+	}
+
+	QApplication::clipboard()->setText( lines.join( QLatin1Char( '\n' ) ) );
+}
+
+
+void LineView::updateScrollBars( void )
+{
+	QFontMetrics metrics( font() );
+	int page = qMax( 1, viewport()->height() / metrics.lineSpacing() );
+
+	QScrollBar* vsb = verticalScrollBar();
+	vsb->setRange( 0, qMax( 0, lineCount() - page ) );
+	vsb->setPageStep( page );
+	vsb->setSingleStep( 1 );
+
+	// monospace assumption, tabs are counted as one character
+	qint64 width = longestLine() * metrics.averageCharWidth() + gutterWidth() + 8;
+	width = qMin( width, qint64( INT_MAX / 2 ) );
+
+	QScrollBar* hsb = horizontalScrollBar();
+	hsb->setRange( 0, qMax( 0, int( width ) - viewport()->width() ) );
+	hsb->setPageStep( viewport()->width() );
+	hsb->setSingleStep( metrics.averageCharWidth() );
+
+	viewport()->update();
+}
+
+
+int LineView::lineAt( int y ) const
+{
+	int n = verticalScrollBar()->value() + y / fontMetrics().lineSpacing();
+	return qBound( 0, n, lineCount() - 1 );
+}
+
+
+void LineView::paintEvent( QPaintEvent* e )
+{
+	QPainter painter( viewport() );
+	painter.setFont( font() );
+
+	QFontMetrics metrics( font() );
+	int height = metrics.lineSpacing();
+	int gutter = gutterWidth();
+
+	int first = verticalScrollBar()->value() + e->rect().top() / height;
+	int last = qMin( lineCount() - 1, verticalScrollBar()->value() + e->rect().bottom() / height );
+
+	int selfirst = qMin( m_anchor, m_cursor );
+	int sellast = qMax( m_anchor, m_cursor );
+
+	QTextOption option;
+	option.setWrapMode( QTextOption::NoWrap );
+	if( m_tabStop > 0 )
+	{
+		option.setTabStop( m_tabStop );
+	}
+
+	int top = ( first - verticalScrollBar()->value() ) * height;
+	QRectF box( gutter + 4 - horizontalScrollBar()->value(), top,
+				viewport()->width() + horizontalScrollBar()->value(), height );
+	QRectF number( 0, top, gutter - 4, height );
+
+	if( gutter > 0 )
+	{
+		painter.fillRect( QRect( 0, e->rect().top(), gutter, e->rect().height() ), Qt::lightGray );
+	}
+
+	for( int n = first; n <= last; ++n )
+	{
+		painter.setClipRect( QRect( gutter, 0, viewport()->width() - gutter, viewport()->height() ) );
+
+		if( m_anchor >= 0 && n >= selfirst && n <= sellast )
+		{
+			painter.fillRect( QRectF( gutter, box.top(), viewport()->width(), height ), palette().highlight() );
+			painter.setPen( palette().color( QPalette::HighlightedText ) );
+		}
+		else
+		{
+			painter.setPen( palette().color( QPalette::Text ) );
+		}
+
+		painter.drawText( box, line( n ), option );
+
+		if( gutter > 0 )
+		{
+			painter.setClipping( false );
+			painter.setPen( Qt::black );
+			painter.drawText( number, Qt::AlignRight, QString::number( n + 1 ) );
+		}
+
+		box.translate( 0, height );
+		number.translate( 0, height );
+	}
+}
+
+
+void LineView::resizeEvent( QResizeEvent* e )
+{
+	QAbstractScrollArea::resizeEvent( e );
+	updateScrollBars();
+}
+
+
+void LineView::changeEvent( QEvent* e )
+{
+	QAbstractScrollArea::changeEvent( e );
+
+	if( e->type() == QEvent::FontChange )
+	{
+		updateScrollBars();
+	}
+}
+
+
+void LineView::keyPressEvent( QKeyEvent* e )
+{
+	if( e->matches( QKeySequence::Copy ) )
+	{
+		copy();
+		e->accept();
+		return;
+	}
+
+	if( e->matches( QKeySequence::SelectAll ) )
+	{
+		selectAll();
+		e->accept();
+		return;
+	}
+
+	QScrollBar* vsb = verticalScrollBar();
+	switch( e->key() )
+	{
+		case Qt::Key_Home:
+			vsb->setValue( 0 );
+			break;
+		case Qt::Key_End:
+			vsb->setValue( vsb->maximum() );
+			break;
+		case Qt::Key_PageUp:
+			vsb->triggerAction( QAbstractSlider::SliderPageStepSub );
+			break;
+		case Qt::Key_PageDown:
+			vsb->triggerAction( QAbstractSlider::SliderPageStepAdd );
+			break;
+		case Qt::Key_Up:
+			vsb->triggerAction( QAbstractSlider::SliderSingleStepSub );
+			break;
+		case Qt::Key_Down:
+			vsb->triggerAction( QAbstractSlider::SliderSingleStepAdd );
+			break;
+		default:
+			QAbstractScrollArea::keyPressEvent( e );
+			return;
+	}
+
+	e->accept();
+}
+
+
+void LineView::mousePressEvent( QMouseEvent* e )
+{
+	if( e->button() == Qt::LeftButton && lineCount() > 0 )
+	{
+		m_cursor = lineAt( e->pos().y() );
+		if( ! ( e->modifiers() & Qt::ShiftModifier ) || m_anchor < 0 )
+		{
+			m_anchor = m_cursor;
+		}
+		viewport()->update();
+	}
+
+	QAbstractScrollArea::mousePressEvent( e );
+}
+
+
+void LineView::mouseMoveEvent( QMouseEvent* e )
+{
+	if( ( e->buttons() & Qt::LeftButton ) && m_anchor >= 0 )
+	{
+		m_cursor = lineAt( e->pos().y() );
+		viewport()->update();
+	}
+
+	QAbstractScrollArea::mouseMoveEvent( e );
+}
@@ -0,0 +1,64 @@
+#ifndef LINEVIEW_H
+#define LINEVIEW_H
+
+#include <QAbstractScrollArea>
+
+
+// Read-only grid of lines, scrolled a line at a time.
+//
+// Subclasses supply the lines; this paints the ones inside the viewport
+// (with line numbers when gutterWidth() is non-zero) and handles scrolling,
+// whole-line selection and copying.
+class LineView : public QAbstractScrollArea
+{
+	Q_OBJECT
+
+	public:
+
+		explicit LineView( QWidget* parent = 0 );
+
+		virtual int lineCount( void ) const = 0;
+		virtual QString line( int n ) const = 0;
+
+		void setTabStopWidth( int width );
+
+	public slots:
+
+		void selectAll( void );
+		void copy( void );
+
+	protected:
+
+		// in characters, for the horizontal range
+		virtual qint64 longestLine( void ) const = 0;
+
+		// line number column, none by default
+		virtual int gutterWidth( void ) const;
+
+		// copying more than this many lines to the clipboard is refused
+		void setCopyLimit( int lines );
+
+		virtual void paintEvent( QPaintEvent* e ) Q_DECL_OVERRIDE;
+		virtual void resizeEvent( QResizeEvent* e ) Q_DECL_OVERRIDE;
+		virtual void changeEvent( QEvent* e ) Q_DECL_OVERRIDE;
+		virtual void keyPressEvent( QKeyEvent* e ) Q_DECL_OVERRIDE;
+		virtual void mousePressEvent( QMouseEvent* e ) Q_DECL_OVERRIDE;
+		virtual void mouseMoveEvent( QMouseEvent* e ) Q_DECL_OVERRIDE;
+
+		int lineAt( int y ) const;
+
+		// selected line range, anchor and cursor; -1 when nothing is selected
+		int m_anchor;
+		int m_cursor;
+
+	protected slots:
+
+		void updateScrollBars( void );
+
+	private:
+
+		int m_tabStop;
+		int m_copyLimit;
+};
+
+#endif // LINEVIEW_H
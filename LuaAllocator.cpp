@@ -0,0 +1,253 @@
+#include "LuaAllocator.h"
+
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+	size_t const class_size[] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+	// (n + 15) / 16 -> size class
+	signed char const class_index[] =
+	{
+		0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+	};
+}
+
+
+LuaAllocator::LuaAllocator( void ) :
+	m_cursor( 0 ),
+	m_end( 0 ),
+	m_limit( 0 ),
+	m_used( 0 ),
+	m_peak( 0 ),
+	m_reserved( 0 )
+{
+	for( int i = 0; i < class_count; ++i )
+	{
+		m_free[i] = 0;
+	}
+}
+
+
+LuaAllocator::~LuaAllocator( void )
+{
+	release();
+}
+
+
+void LuaAllocator::setLimit( size_t bytes )
+{
+	m_limit.store( bytes, std::memory_order_relaxed );
+}
+
+
+size_t LuaAllocator::limit( void ) const
+{
+	return m_limit.load( std::memory_order_relaxed );
+}
+
+
+size_t LuaAllocator::used( void ) const
+{
+	return m_used.load( std::memory_order_relaxed );
+}
+
+
+size_t LuaAllocator::peak( void ) const
+{
+	return m_peak.load( std::memory_order_relaxed );
+}
+
+
+void LuaAllocator::resetPeak( void )
+{
+	m_peak.store( used(), std::memory_order_relaxed );
+}
+
+
+size_t LuaAllocator::reserved( void ) const
+{
+	return m_reserved.load( std::memory_order_relaxed );
+}
+
+
+void LuaAllocator::release( void )
+{
+	for( char* block : m_blocks )
+	{
+		std::free( block );
+	}
+
+	m_reserved.fetch_sub( m_blocks.size() * block_size, std::memory_order_relaxed );
+	m_blocks.clear();
+
+	for( int i = 0; i < class_count; ++i )
+	{
+		m_free[i] = 0;
+	}
+
+	m_cursor = m_end = 0;
+}
+
+
+int LuaAllocator::sizeClass( size_t n )
+{
+	return n <= max_small ? class_index[( n + 15 ) / 16] : -1;
+}
+
+
+void* LuaAllocator::allocate( size_t n )
+{
+	int c = sizeClass( n );
+
+	if( c < 0 )
+	{
+		void* p = std::malloc( n );
+		if( p )
+		{
+			m_reserved.fetch_add( n, std::memory_order_relaxed );
+		}
+		return p;
+	}
+
+	if( m_free[c] )
+	{
+		FreeNode* node = m_free[c];
+		m_free[c] = node->next;
+		return node;
+	}
+
+	size_t size = class_size[c];
+	if( m_cursor == 0 || size_t( m_end - m_cursor ) < size )
+	{
+		// the tail of the previous block is left unused
+		char* block = static_cast<char*>( std::malloc( block_size ) );
+		if( block == 0 )
+		{
+			return 0;
+		}
+
+		m_blocks.push_back( block );
+		m_reserved.fetch_add( block_size, std::memory_order_relaxed );
+		m_cursor = block;
+		m_end = block + block_size;
+	}
+
+	void* p = m_cursor;
+	m_cursor += size;
+	return p;
+}
+
+
+void LuaAllocator::deallocate( void* p, size_t n )
+{
+	int c = sizeClass( n );
+
+	if( c < 0 )
+	{
+		std::free( p );
+		m_reserved.fetch_sub( n, std::memory_order_relaxed );
+		return;
+	}
+
+	FreeNode* node = static_cast<FreeNode*>( p );
+	node->next = m_free[c];
+	m_free[c] = node;
+}
+
+
+void LuaAllocator::account( size_t released, size_t taken )
+{
+	size_t used = m_used.load( std::memory_order_relaxed ) - released + taken;
+	m_used.store( used, std::memory_order_relaxed );
+
+	if( used > m_peak.load( std::memory_order_relaxed ) )
+	{
+		m_peak.store( used, std::memory_order_relaxed );
+	}
+}
+
+
+void* LuaAllocator::alloc( void* ud, void* ptr, size_t osize, size_t nsize )
+{
+	LuaAllocator* a = static_cast<LuaAllocator*>( ud );
+
+	// without a block osize is only the type of object being created
+	size_t old = ptr ? osize : 0;
+
+	if( nsize == 0 )
+	{
+		if( ptr )
+		{
+			a->deallocate( ptr, old );
+			a->account( old, 0 );
+		}
+		return 0;
+	}
+
+	bool grow = nsize > old;
+	if( grow )
+	{
+		size_t limit = a->limit();
+		if( limit && a->used() - old + nsize > limit )
+		{
+			return 0;
+		}
+	}
+
+	int oc = ptr ? sizeClass( old ) : -2;
+	int nc = sizeClass( nsize );
+
+	// still fits the same slot
+	if( oc >= 0 && oc == nc )
+	{
+		a->account( old, nsize );
+		return ptr;
+	}
+
+	// large to large stays with the C heap
+	if( ptr && oc < 0 && nc < 0 )
+	{
+		void* p = std::realloc( ptr, nsize );
+		if( p == 0 )
+		{
+			// a failed shrink keeps the old, larger block
+			if( ! grow )
+			{
+				a->account( old, nsize );
+				return ptr;
+			}
+			return 0;
+		}
+
+		a->m_reserved.fetch_add( nsize - old, std::memory_order_relaxed );
+		a->account( old, nsize );
+		return p;
+	}
+
+	void* p = a->allocate( nsize );
+	if( p == 0 )
+	{
+		if( grow )
+		{
+			return 0;
+		}
+
+		// Shrinking must not fail, keep the old block. Lua frees it with the
+		// new size later, so a small slot lands on a smaller class list; a
+		// large block is stranded until exit, on this out of memory path only.
+		a->account( old, nsize );
+		return ptr;
+	}
+
+	if( ptr )
+	{
+		std::memcpy( p, ptr, old < nsize ? old : nsize );
+		a->deallocate( ptr, old );
+	}
+
+	a->account( old, nsize );
+	return p;
+}
@@ -0,0 +1,78 @@
+#ifndef LUAALLOCATOR_H
+#define LUAALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+
+// lua_Alloc for one vm with size class pools, accounting and a hard limit.
+//
+// Small blocks (Lua strings, tables, closures, ...) come from per class free
+// lists carved out of large arena blocks which are only returned in one go
+// by release(), after lua_close. Larger blocks go to the C heap. Growing an
+// allocation beyond the limit fails, which Lua reports as a memory error;
+// shrinking never fails, as Lua requires.
+//
+// The allocator belongs to the vm thread; the counters may be read from any
+// thread.
+class LuaAllocator
+{
+	public:
+
+		LuaAllocator( void );
+		~LuaAllocator( void );
+
+		// for lua_newstate, ud is the LuaAllocator
+		static void* alloc( void* ud, void* ptr, size_t osize, size_t nsize );
+
+		// bytes Lua may hold at once, 0 for no limit
+		void setLimit( size_t bytes );
+		size_t limit( void ) const;
+
+		// bytes held by Lua right now, and the most since resetPeak()
+		size_t used( void ) const;
+		size_t peak( void ) const;
+		void resetPeak( void );
+
+		// bytes taken from the system for arenas and large blocks
+		size_t reserved( void ) const;
+
+		// free every arena block; only once the lua_State using them is closed
+		void release( void );
+
+	private:
+
+		enum
+		{
+			class_count = 8,
+			max_small = 256,
+			block_size = 64 << 10
+		};
+
+		struct FreeNode
+		{
+			FreeNode* next;
+		};
+
+		LuaAllocator( LuaAllocator const& );
+		LuaAllocator& operator=( LuaAllocator const& );
+
+		static int sizeClass( size_t n );
+
+		void* allocate( size_t n );
+		void deallocate( void* p, size_t n );
+		void account( size_t released, size_t taken );
+
+		FreeNode* m_free[class_count];
+		std::vector<char*> m_blocks;
+		char* m_cursor;
+		char* m_end;
+
+		std::atomic<size_t> m_limit;
+		std::atomic<size_t> m_used;
+		std::atomic<size_t> m_peak;
+		std::atomic<size_t> m_reserved;
+};
+
+#endif // LUAALLOCATOR_H
@@ -0,0 +1,293 @@
+#include "LuaBytecodeCache.h"
+
+#include <lua.hpp>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+
+namespace
+{
+	char const* bufferReader( lua_State* L, void* data, size_t* size )
+	{
+		(void) L;
+		QByteArray const*& source = *static_cast<QByteArray const**>( data );
+		if( source == 0 )
+		{
+			*size = 0;
+			return 0;
+		}
+
+		char const* p = source->constData();
+		*size = size_t( source->size() );
+		source = 0;
+		return p;
+	}
+
+	int writer( lua_State* L, void const* p, size_t sz, void* ud )
+	{
+		(void) L;
+		static_cast<QByteArray*>( ud )->append( static_cast<char const*>( p ), int( sz ) );
+		return 0;
+	}
+}
+
+
+LuaBytecodeCache* LuaBytecodeCache::instance( void )
+{
+	static LuaBytecodeCache cache;
+	return &cache;
+}
+
+
+LuaBytecodeCache::LuaBytecodeCache( void ) :
+	m_memory( 64 << 20 ),
+	m_disk( true ),
+	m_diskLimit( Q_INT64_C( 256 ) << 20 ),
+	m_diskBytes( -1 ),
+	m_pruning( false )
+{
+	m_dir = QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) + QLatin1String( "/bytecode" );
+}
+
+
+void LuaBytecodeCache::setMemoryLimit( int bytes )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_memory.setMaxCost( bytes );
+}
+
+
+void LuaBytecodeCache::setDiskEnabled( bool enable )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_disk = enable;
+}
+
+
+void LuaBytecodeCache::setDiskLimit( qint64 bytes )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_diskLimit = bytes;
+	m_diskBytes = -1;
+}
+
+
+QString LuaBytecodeCache::directory( void ) const
+{
+	return m_dir;
+}
+
+
+LuaBytecodeCache::Statistics LuaBytecodeCache::statistics( void ) const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	return m_stats;
+}
+
+
+void LuaBytecodeCache::clear( void )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_memory.clear();
+		m_stats = Statistics();
+		m_diskBytes = -1;
+	}
+
+	QDir dir( m_dir );
+	for( auto const& name : dir.entryList( QStringList() << QLatin1String( "*.luac" ), QDir::Files ) )
+	{
+		dir.remove( name );
+	}
+}
+
+
+QString LuaBytecodeCache::path( QByteArray const& key ) const
+{
+	return m_dir + QLatin1Char( '/' ) + QString::fromLatin1( key.toHex() ) + QLatin1String( ".luac" );
+}
+
+
+QByteArray LuaBytecodeCache::lookup( QByteArray const& key, bool* disk )
+{
+	*disk = false;
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( QByteArray* code = m_memory.object( key ) )
+		{
+			return *code;
+		}
+		if( ! m_disk )
+		{
+			return QByteArray();
+		}
+	}
+
+	// the file is read unlocked, other vms keep hitting memory meanwhile
+	QFile file( path( key ) );
+	if( ! file.open( QFile::ReadOnly ) )
+	{
+		return QByteArray();
+	}
+	QByteArray code = file.readAll();
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_memory.insert( key, new QByteArray( code ), code.size() );
+	*disk = true;
+	return code;
+}
+
+
+void LuaBytecodeCache::store( QByteArray const& key, QByteArray const& code )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_memory.insert( key, new QByteArray( code ), code.size() );
+		if( ! m_disk )
+		{
+			return;
+		}
+	}
+
+	if( ! QDir().mkpath( m_dir ) )
+	{
+		return;
+	}
+
+	// written aside and renamed, a concurrent reader never sees half a chunk
+	QSaveFile file( path( key ) );
+	if( ! file.open( QFile::WriteOnly ) )
+	{
+		return;
+	}
+	file.write( code );
+	if( ! file.commit() )
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( m_diskBytes >= 0 )
+		{
+			m_diskBytes += code.size();
+		}
+		if( m_pruning || m_diskLimit <= 0 || ( m_diskBytes >= 0 && m_diskBytes <= m_diskLimit ) )
+		{
+			return;
+		}
+		m_pruning = true;
+	}
+
+	prune();
+}
+
+
+void LuaBytecodeCache::prune( void )
+{
+	qint64 limit;
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		limit = m_diskLimit;
+	}
+
+	QDir dir( m_dir );
+	QFileInfoList files = dir.entryInfoList( QStringList() << QLatin1String( "*.luac" ), QDir::Files, QDir::Time | QDir::Reversed );
+
+	qint64 total = 0;
+	for( auto const& info : files )
+	{
+		total += info.size();
+	}
+
+	// oldest first, down to three quarters so this is not done on every store
+	if( total > limit )
+	{
+		for( auto const& info : files )
+		{
+			if( total <= limit - limit / 4 )
+			{
+				break;
+			}
+			if( dir.remove( info.fileName() ) )
+			{
+				total -= info.size();
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_diskBytes = total;
+	m_pruning = false;
+}
+
+
+void LuaBytecodeCache::beginKey( QCryptographicHash& hash, char const* chunkname )
+{
+	// the dump carries the chunk name, so it is part of the key
+	hash.addData( LUA_RELEASE );
+	hash.addData( chunkname, int( qstrlen( chunkname ) ) + 1 );
+}
+
+
+int LuaBytecodeCache::load( lua_State* L, QByteArray const& source, char const* chunkname, bool* hit )
+{
+	QCryptographicHash hash( QCryptographicHash::Sha1 );
+	beginKey( hash, chunkname );
+	hash.addData( source );
+
+	QByteArray const* data = &source;
+	return load( L, hash.result(), &bufferReader, &data, chunkname, hit );
+}
+
+
+int LuaBytecodeCache::load( lua_State* L, QByteArray const& key, Reader reader, void* data, char const* chunkname, bool* hit )
+{
+	bool disk;
+	QByteArray code = lookup( key, &disk );
+
+	if( ! code.isEmpty() )
+	{
+		if( luaL_loadbufferx( L, code.constData(), size_t( code.size() ), chunkname, "b" ) == LUA_OK )
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			++( disk ? m_stats.diskHits : m_stats.memoryHits );
+
+			if( hit )
+			{
+				*hit = true;
+			}
+			return LUA_OK;
+		}
+
+		// unreadable (e.g. truncated on disk), compile it again
+		lua_pop( L, 1 );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		++m_stats.misses;
+	}
+
+	if( hit )
+	{
+		*hit = false;
+	}
+
+	int err = lua_load( L, reader, data, chunkname, 0 );
+	if( err == LUA_OK )
+	{
+		// keep debug info, tracebacks and the profiler need line numbers
+		QByteArray dump;
+		if( lua_dump( L, &writer, &dump, 0 ) == 0 && ! dump.isEmpty() )
+		{
+			store( key, dump );
+		}
+	}
+
+	return err;
+}
@@ -0,0 +1,88 @@
+#ifndef LUABYTECODECACHE_H
+#define LUABYTECODECACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QString>
+
+#include <mutex>
+
+#ifdef _WIN32
+#include <mingw.mutex.h>
+#endif
+
+struct lua_State;
+class QCryptographicHash;
+
+
+// Compiled chunks keyed by a hash of their name and source.
+//
+// Chunks are kept in memory (bounded) and under the user's cache directory,
+// so unchanged scripts and modules are loaded from bytecode instead of being
+// parsed again, across runs and across sessions. One cache is shared by all
+// vms in the process. Files are read and written outside its lock, and the
+// oldest are pruned when the directory grows past the disk limit.
+class LuaBytecodeCache
+{
+	public:
+
+		struct Statistics
+		{
+			Statistics( void ) :
+				memoryHits( 0 ),
+				diskHits( 0 ),
+				misses( 0 )
+			{
+			}
+
+			quint64 memoryHits;
+			quint64 diskHits;
+			quint64 misses;
+		};
+
+		// same signature as lua_Reader
+		typedef char const* ( *Reader )( lua_State* L, void* data, size_t* size );
+
+		static LuaBytecodeCache* instance( void );
+
+		// a chunk's key is the hash of its source after beginKey()
+		static void beginKey( QCryptographicHash& hash, char const* chunkname );
+
+		// like luaL_loadbuffer; hit tells whether the parser was skipped
+		int load( lua_State* L, QByteArray const& source, char const* chunkname, bool* hit = 0 );
+
+		// like lua_load for a source streamed in pieces, the reader is only
+		// used on a miss
+		int load( lua_State* L, QByteArray const& key, Reader reader, void* data, char const* chunkname, bool* hit = 0 );
+
+		void setMemoryLimit( int bytes );
+		void setDiskEnabled( bool enable );
+		void setDiskLimit( qint64 bytes );
+
+		QString directory( void ) const;
+
+		Statistics statistics( void ) const;
+
+		// forget everything, on disk too
+		void clear( void );
+
+	private:
+
+		LuaBytecodeCache( void );
+
+		QByteArray lookup( QByteArray const& key, bool* disk );
+		void store( QByteArray const& key, QByteArray const& code );
+		QString path( QByteArray const& key ) const;
+		void prune( void );
+
+		mutable std::mutex m_mutex;
+		QCache<QByteArray, QByteArray> m_memory;	// cost in bytes
+		QString m_dir;
+		bool m_disk;
+		qint64 m_diskLimit;
+		qint64 m_diskBytes;	// -1 until the directory has been scanned
+		bool m_pruning;
+		Statistics m_stats;
+};
+
+#endif // LUABYTECODECACHE_H
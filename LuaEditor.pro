@@ -1,36 +1,14 @@
 #-------------------------------------------------
 #
-# Project created by QtCreator 2016-09-10T19:59:27
+# LuaEditor (gui), luarun (headless runner) and bench (editor and vm
+# benchmarks), all built on the engine in engine.pri
 #
 #-------------------------------------------------
 
-QT       += core gui
+TEMPLATE = subdirs
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+SUBDIRS += editor luarun bench
 
-TARGET = LuaEditor
-TEMPLATE = app
-
-
-SOURCES += main.cpp\
-		MainWindow.cpp \
-	LuaForm.cpp \
-	LuaHighlighter.cpp \
-	LuaThread.cpp \
-	CodeEditor.cpp
-
-HEADERS  += MainWindow.h \
-	LuaForm.h \
-	LuaHighlighter.h \
-	LuaThread.h \
-	CodeEditor.h
-
-FORMS    += MainWindow.ui \
-	LuaForm.ui
-
-
-CONFIG += link_pkgconfig
-PKGCONFIG = lua5.3-c++
-
-DISTFILES += \
-    README.md
+editor.file = editor.pro
+luarun.subdir = luarun
+bench.subdir = bench
@@ -7,35 +7,297 @@
 #include <QFontDialog>
 #include <QFile>
 #include <QFont>
-#include <QScrollBar>
+#include <QVBoxLayout>
+#include <QMessageBox>
+#include <QTimer>
 #include <QDebug>
+#include <QTextDocument>
+#include <QTextBlock>
 
+#include "LuaBytecodeCache.h"
 #include "LuaHighlighter.h"
+#include "LuaPool.h"
+#include "SyntaxChecker.h"
+#include "LargeFileView.h"
+#include "FindBar.h"
+#include "FileWriter.h"
+#include "EditJournal.h"
+#include "MappedFile.h"
+
+
+namespace
+{
+	// The editor's blocks, encoded on the gui thread into pieces of about
+	// 16KB. The vm only reads the pieces, so the document stays editable
+	// while the script is parsed.
+	class DocumentSource : public LuaThread::Source
+	{
+		public:
+
+			explicit DocumentSource( QTextDocument* doc )
+				: m_next( 0 )
+			{
+				QByteArray piece;
+				for( QTextBlock block = doc->firstBlock(); block.isValid(); )
+				{
+					piece += block.text().toUtf8();
+					block = block.next();
+					if( block.isValid() )
+					{
+						piece += '\n';
+					}
+					if( piece.size() >= 16 * 1024 || ! block.isValid() )
+					{
+						m_pieces.append( piece );
+						piece.clear();
+					}
+				}
+			}
+
+			QByteArray next( void ) override
+			{
+				return m_next < m_pieces.size() ? m_pieces.at( m_next++ ) : QByteArray();
+			}
+
+			void rewind( void ) override
+			{
+				m_next = 0;
+			}
+
+		private:
+
+			QList<QByteArray> m_pieces;
+			int m_next;
+	};
+
+	// Slices of a mapped file, handed over without copying. The source maps
+	// the file itself, so the viewer may open another file (or the run be
+	// abandoned) while the vm still reads it.
+	class MappedSource : public LuaThread::Source
+	{
+		public:
+
+			explicit MappedSource( QString const& filename )
+				: m_file( filename ), m_data( 0 ), m_size( 0 ), m_pos( 0 )
+			{
+				if( m_file.open( QFile::ReadOnly ) )
+				{
+					m_size = m_file.size();
+					m_data = reinterpret_cast<char const*>( m_file.map( 0, m_size ) );
+				}
+			}
+
+			bool isMapped( void ) const
+			{
+				return m_data != 0;
+			}
+
+			QByteArray next( void ) override
+			{
+				qint64 n = qMin<qint64>( m_size - m_pos, 1024 * 1024 );
+				QByteArray piece = QByteArray::fromRawData( m_data + m_pos, int( n ) );
+				m_pos += n;
+				return piece;
+			}
+
+			void rewind( void ) override
+			{
+				m_pos = 0;
+			}
+
+		private:
+
+			QFile m_file;
+			char const* m_data;
+			qint64 m_size;
+			qint64 m_pos;
+	};
+}
 
 
 LuaForm::LuaForm(QWidget *parent) :
 	QWidget(parent),
-	m_ui(new Ui::LuaForm)
+	m_ui(new Ui::LuaForm),
+	m_savingRevision( -1 ),
+	m_generation( 0 )
 {
 	m_ui->setupUi( this );
-	m_ui->plainTextOutput->setReadOnly( true );
-	new LuaHighlighter( m_ui->sourceEdit->document() );
+	m_highlighter = new LuaHighlighter( m_ui->sourceEdit->document() );
+	connect( m_ui->sourceEdit, &CodeEditor::visibleBlocksChanged, m_highlighter, &LuaHighlighter::setVisibleBlocks );
+
+	m_checker = new SyntaxChecker( m_ui->sourceEdit->document() );
+	connect( m_checker, &SyntaxChecker::checked, m_ui->sourceEdit, &CodeEditor::setErrorLine );
 
 	connect( m_ui->sourceEdit, &CodeEditor::textChanged, this, &LuaForm::modified );
 	connect( m_ui->sourceEdit, &CodeEditor::requestSave, this, &LuaForm::on_buttonSave_clicked );
 
+	// shares the editor's place in the splitter, shown instead of it for large files
+	QWidget* host = new QWidget;
+	QVBoxLayout* layout = new QVBoxLayout( host );
+	layout->setContentsMargins( 0, 0, 0, 0 );
+	m_ui->splitter->insertWidget( m_ui->splitter->indexOf( m_ui->sourceEdit ), host );
+	m_large = new LargeFileView;
+	layout->addWidget( m_ui->sourceEdit );
+	layout->addWidget( m_large );
+	m_large->hide();
+
+	m_find = new FindBar( m_ui->sourceEdit );
+	layout->addWidget( m_find );
+	m_find->hide();
+	connect( m_ui->sourceEdit, &CodeEditor::requestFind, m_find, &FindBar::activate );
+	connect( m_large, &LargeFileView::indexed, [this]( int lines ){
+		emit status( tr( "%1: %2 lines, opened read-only" ).arg( m_filename ).arg( lines ) );
+	} );
+
+	// unsaved edits, kept until the file is saved; earlier sessions' are offered once running
+	m_journal = new EditJournal( m_ui->sourceEdit->document() );
+	QTimer::singleShot( 0, this, [this]{
+		if( ! m_journal->isEnabled() )
+		{
+			return;
+		}
+
+		for( auto const& journal : EditJournal::pending() )
+		{
+			if( recover( journal ) )
+			{
+				break;
+			}
+		}
+	} );
+
+	m_writer = new FileWriter( this );
+	connect( m_writer, &FileWriter::written, [this]( QString const& f, quint64 tag ){
+		// saved from a document that has been replaced since
+		if( quint32( tag >> 32 ) != m_generation )
+		{
+			emit status( tr( "Saved %1" ).arg( f ) );
+			return;
+		}
+
+		int revision = int( quint32( tag ) );
+		if( isLargeFile() && f != m_filename )
+		{
+			// carry on viewing the copy, as after saving a document elsewhere
+			m_large->open( f );
+		}
+		m_filename = f;
+
+		// edits made while it was being written are still unsaved
+		if( isLargeFile() || revision == m_ui->sourceEdit->document()->revision() )
+		{
+			m_journal->reset( f );
+			emit saved();
+		}
+		else if( ! isLargeFile() )
+		{
+			// the journal's base file just changed under it
+			m_journal->reset( f );
+			m_journal->compact();
+		}
+		emit filename( f );
+		emit status( tr( "Saved %1" ).arg( f ) );
+	} );
+	connect( m_writer, &FileWriter::failed, [this]( QString const& f, QString const& error ){
+		m_savingFile.clear();
+		emit status( tr( "Saving %1 failed: %2" ).arg( f ).arg( error ) );
+	} );
+
 	m_vm = new LuaThread( this );
 	connect( m_vm, &LuaThread::fromStdOut, this, &LuaForm::vm_stdout );
 
 
 	m_ui->buttonStop->setEnabled( false );
+	m_ui->buttonPause->setEnabled( false );
 	connect( m_vm, &LuaThread::started, [this]{
 		m_ui->buttonStop->setEnabled( true );
+		m_ui->buttonPause->setEnabled( true );
 		m_ui->buttonStart->setEnabled( false );
 	} );
 	connect( m_vm, &LuaThread::stopped, [this]{
 		m_ui->buttonStart->setEnabled( true );
 		m_ui->buttonStop->setEnabled( false );
+		m_ui->buttonPause->setEnabled( false );
+		m_ui->buttonPause->setText( tr( "Pause" ) );
+		m_ui->sourceEdit->setPausedLine( 0 );
+
+		LuaThread::Statistics stats = m_vm->statistics();
+		double mb = stats.outputBytes / ( 1024.0 * 1024.0 );
+		QString msg = tr( "Finished in %1 s, %2 MB output (%3 MB/s), %4 MB peak memory" )
+			.arg( stats.wallSeconds, 0, 'f', 3 )
+			.arg( mb, 0, 'f', 2 )
+			.arg( stats.wallSeconds > 0 ? mb / stats.wallSeconds : 0.0, 0, 'f', 1 )
+			.arg( stats.peakBytes / ( 1024.0 * 1024.0 ), 0, 'f', 1 );
+
+		if( stats.status == LuaThread::StoppedExit && stats.stopReason != LuaThread::StopRequested )
+		{
+			QString reason = QString::fromLatin1( LuaThread::describe( stats.stopReason ) );
+			msg = tr( "Stopped, %1. " ).arg( reason ) + msg;
+			m_ui->outputView->append( tr( "[stopped: %1 after %2 s wall, %3 s cpu, %4 instructions]\n" )
+				.arg( reason )
+				.arg( stats.wallSeconds, 0, 'f', 3 )
+				.arg( stats.cpuSeconds, 0, 'f', 3 )
+				.arg( stats.instructions ) );
+		}
+
+		if( stats.cacheHits + stats.cacheMisses > 0 )
+		{
+			msg += tr( ", %1 of %2 chunks from bytecode cache" ).arg( stats.cacheHits ).arg( stats.cacheHits + stats.cacheMisses );
+		}
+
+		if( m_vm->isProfiling() )
+		{
+			LuaProfiler::Report report = m_vm->profile();
+			m_ui->sourceEdit->setLineHeat( report.lines );
+			m_ui->buttonSaveProfile->setEnabled( report.samples > 0 );
+			msg += tr( ", %1 samples" ).arg( report.samples );
+		}
+
+		emit status( msg );
+	} );
+	connect( m_vm, &LuaThread::memoryChanged, [this]( quint64 bytes ){
+		emit status( tr( "Running, %1 MB in use" ).arg( bytes / ( 1024.0 * 1024.0 ), 0, 'f', 1 ) );
+	} );
+
+	// debugger: breakpoints from the editor's gutter, the paused line shown in it
+	connect( m_ui->sourceEdit, &CodeEditor::breakpointsChanged, [this]( QList<int> const& lines ){
+		m_vm->setBreakpoints( m_vm->chunkName(), lines );
+	} );
+	connect( m_vm, &LuaThread::paused, [this]( QString const& chunk, int line ){
+		m_ui->buttonPause->setText( tr( "Continue" ) );
+
+		if( chunk != m_vm->chunkName() || isLargeFile() )
+		{
+			emit status( tr( "Paused at %1:%2" ).arg( chunk ).arg( line ) );
+			return;
+		}
+
+		m_ui->sourceEdit->setPausedLine( line );
+		m_ui->sourceEdit->setTextCursor( QTextCursor( m_ui->sourceEdit->document()->findBlockByNumber( line - 1 ) ) );
+		m_ui->sourceEdit->centerCursor();
+		emit status( tr( "Paused at line %1" ).arg( line ) );
+	} );
+	connect( m_vm, &LuaThread::resumed, [this]{
+		m_ui->buttonPause->setText( tr( "Pause" ) );
+		m_ui->sourceEdit->setPausedLine( 0 );
+	} );
+
+
+	// suites run beside the editor's own vm, output tagged by script
+	m_pool = new LuaPool( this );
+	connect( m_pool, &LuaPool::jobTaggedOutput, [this]( int, QString const& text ){
+		m_ui->outputView->append( text );
+	} );
+	connect( m_pool, &LuaPool::finished, [this]{
+		LuaPool::Summary summary = m_pool->summary();
+		m_ui->buttonSuite->setText( tr( "Run Suite" ) );
+		emit status( tr( "%1 scripts, %2 failed in %3 s (%4 scripts/s), latency mean %5 s, p95 %6 s" )
+			.arg( summary.jobs )
+			.arg( summary.failures )
+			.arg( summary.wallSeconds, 0, 'f', 3 )
+			.arg( summary.jobsPerSecond(), 0, 'f', 1 )
+			.arg( summary.meanLatency, 0, 'f', 3 )
+			.arg( summary.p95Latency, 0, 'f', 3 ) );
 	} );
 
 
@@ -48,8 +310,30 @@ LuaForm::LuaForm(QWidget *parent) :
 	settings.beginGroup( QLatin1String( "lua" ) );
 	font.fromString( settings.value( QLatin1String( "font" ), font.toString() ).toString() );
 	m_ui->splitter->restoreState( settings.value( QLatin1String( "splitter" ), m_ui->splitter->saveState() ).toByteArray() );
+	m_ui->buttonWarm->setChecked( settings.value( QLatin1String( "warm" ), false ).toBool() );
+	m_ui->buttonProfile->setChecked( settings.value( QLatin1String( "profile" ), false ).toBool() );
+	m_vm->setProfilingRate( settings.value( QLatin1String( "profile_rate" ), 1000 ).toInt() );
+	m_vm->setMemoryLimit( settings.value( QLatin1String( "memory_limit_mb" ), 0 ).toULongLong() << 20 );
+	m_pool->setMemoryLimit( m_vm->memoryLimit() );
+	m_vm->setBytecodeCache( settings.value( QLatin1String( "bytecode_cache" ), true ).toBool() );
+	m_pool->setBytecodeCache( settings.value( QLatin1String( "bytecode_cache" ), true ).toBool() );
+	LuaBytecodeCache::instance()->setDiskLimit( settings.value( QLatin1String( "bytecode_cache_mb" ), 256 ).toLongLong() << 20 );
+	LuaThread::Budget budget;
+	budget.wallSeconds = settings.value( QLatin1String( "time_limit_s" ), 0 ).toDouble();
+	budget.cpuSeconds = settings.value( QLatin1String( "cpu_limit_s" ), 0 ).toDouble();
+	budget.instructions = settings.value( QLatin1String( "instruction_limit" ), 0 ).toULongLong();
+	m_vm->setBudget( budget );
+	m_pool->setBudget( budget );
+	m_ui->outputView->setMaximumLines( settings.value( QLatin1String( "output_lines" ), m_ui->outputView->maximumLines() ).toInt() );
+	m_ui->outputView->setMaximumBytes( settings.value( QLatin1String( "output_bytes" ), m_ui->outputView->maximumBytes() ).toLongLong() );
+	m_ui->outputView->setSpillToDisk( settings.value( QLatin1String( "output_spill" ), false ).toBool() );
+	m_largeSize = settings.value( QLatin1String( "large_file_bytes" ), Q_INT64_C( 32 ) << 20 ).toLongLong();
+	m_journal->setEnabled( settings.value( QLatin1String( "journal" ), true ).toBool() );
 	settings.endGroup();
 
+	m_ui->buttonReset->setEnabled( m_ui->buttonWarm->isChecked() );
+	m_ui->buttonSaveProfile->setEnabled( false );
+
 	setFont( font );
 }
 
@@ -57,7 +341,8 @@ LuaForm::~LuaForm()
 {
 	QSettings settings;
 	settings.beginGroup( QLatin1String( "lua" ) );
-	settings.setValue( QLatin1String( "font" ), m_ui->plainTextOutput->font().toString() );
+	settings.setValue( QLatin1String( "font" ), m_ui->outputView->font().toString() );
+	settings.setValue( QLatin1String( "output_spill" ), m_ui->outputView->spillToDisk() );
 	settings.setValue( QLatin1String( "splitter" ), m_ui->splitter->saveState() );
 	settings.endGroup();
 
@@ -68,22 +353,166 @@ LuaForm::~LuaForm()
 void LuaForm::setFont( QFont const& font )
 {
 	m_ui->sourceEdit->setFont( font );
-	m_ui->plainTextOutput->setFont( font );
+	m_ui->outputView->setFont( font );
+	m_large->setFont( font );
 
 	QFontMetrics metrics( font );
 	int w = metrics.width( QLatin1Char( ' ' ) ) * 4;
 
 	m_ui->sourceEdit->setTabStopWidth( w );
-	m_ui->plainTextOutput->setTabStopWidth( w );
+	m_ui->outputView->setTabStopWidth( w );
+	m_large->setTabStopWidth( w );
+}
+
+
+bool LuaForm::open( QString const& filename )
+{
+	QFileInfo info( filename );
+	if( ! info.isReadable() )
+	{
+		return false;
+	}
+
+	// unsaved edits to this file from an earlier session (not this one's, about to go)
+	QString journal = EditJournal::path( filename );
+	bool left = m_journal->isEnabled() && journal != EditJournal::path( m_filename ) && QFile::exists( journal );
+
+	if( info.size() >= m_largeSize )
+	{
+		// map the file instead of building a document for it
+		if( ! m_large->open( filename ) )
+		{
+			return false;
+		}
+
+		m_filename = filename;
+		++m_generation;
+		m_journal->setRecording( false );
+		m_ui->sourceEdit->clear();
+		m_ui->sourceEdit->document()->clearUndoRedoStacks();
+		m_journal->setRecording( true );
+		m_journal->reset( filename );
+		m_ui->sourceEdit->hide();
+		m_find->hide();
+		m_large->show();
+	}
+	else
+	{
+		QFile file( filename );
+		if( ! file.open( QFile::ReadOnly ) )
+		{
+			return false;
+		}
+
+		m_filename = filename;
+		++m_generation;
+		m_savingFile.clear();
+		m_large->close();
+		m_large->hide();
+		m_ui->sourceEdit->show();
+		m_journal->setRecording( false );
+		m_ui->sourceEdit->clearBreakpoints();
+		m_ui->sourceEdit->setPlainText( QString::fromLocal8Bit( file.readAll() ) );
+		m_ui->sourceEdit->document()->clearUndoRedoStacks();
+		m_journal->setRecording( true );
+		m_journal->reset( filename );
+	}
+
+	emit saved();
+	emit filename( filename );
+
+	if( left && ! isLargeFile() )
+	{
+		recover( journal );
+	}
+	return true;
+}
+
+
+bool LuaForm::recover( QString const& journal )
+{
+	QString name;
+	QString text;
+	if( ! EditJournal::replay( journal, &name, &text ) )
+	{
+		EditJournal::discard( journal );
+		emit status( tr( "Unsaved changes to %1 could not be recovered, the file has changed since" ).arg( name ) );
+		return false;
+	}
+
+	QString what = name.isEmpty() ? tr( "an untitled script" ) : name;
+	if( QMessageBox::question( this, tr( "Recover" ),
+			tr( "There are unsaved changes to %1 from an earlier session. Recover them?" ).arg( what ) ) != QMessageBox::Yes )
+	{
+		EditJournal::discard( journal );
+		return false;
+	}
+
+	m_journal->setRecording( false );
+	m_large->close();
+	m_large->hide();
+	m_ui->sourceEdit->show();
+	m_ui->sourceEdit->setPlainText( text );
+	m_journal->setRecording( true );
+
+	// carry on journalling from the recovered text
+	m_filename = name;
+	++m_generation;
+	m_savingFile.clear();
+	m_journal->reset( name );
+	m_journal->compact();
+
+	emit filename( name );
+	emit modified();
+	emit status( tr( "Recovered unsaved changes to %1" ).arg( what ) );
+	return true;
+}
+
+
+bool LuaForm::isLargeFile( void ) const
+{
+	return m_large->file()->isOpen();
+}
+
+
+qint64 LuaForm::largeFileSize( void ) const
+{
+	return m_largeSize;
+}
+
+
+// queue a save; the document is snapshotted here, encoded and written behind
+void LuaForm::save( QString const& filename )
+{
+	if( isLargeFile() )
+	{
+		// nothing can have changed, saving in place is a no-op
+		if( QFileInfo( filename ) == QFileInfo( m_filename ) )
+		{
+			emit saved();
+			return;
+		}
+
+		m_writer->copy( m_filename, filename, quint64( m_generation ) << 32 );
+		return;
+	}
+
+	// repeated saves of an unchanged document are already on their way
+	QTextDocument* doc = m_ui->sourceEdit->document();
+	if( filename == m_savingFile && doc->revision() == m_savingRevision )
+	{
+		return;
+	}
+
+	m_savingFile = filename;
+	m_savingRevision = doc->revision();
+	m_writer->write( filename, doc->toPlainText(), quint64( m_generation ) << 32 | quint32( m_savingRevision ) );
 }
 
 
 void LuaForm::vm_stdout( QString const& msg )
 {
-	m_ui->plainTextOutput->moveCursor( QTextCursor::End );
-	m_ui->plainTextOutput->insertPlainText( msg );
-	auto vsb = m_ui->plainTextOutput->verticalScrollBar();
-	vsb->setValue( vsb->maximum() );
+	m_ui->outputView->append( msg );
 }
 
 void LuaForm::on_buttonOpen_clicked()
@@ -97,20 +526,9 @@ void LuaForm::on_buttonOpen_clicked()
 		f = s.value( QLatin1String( "file_lua" ), QString() ).toString();
 	}
 	f = QFileDialog::getOpenFileName( this, QLatin1String( "Open File" ), f, QLatin1String( "*.lua" ) );
-	if( ! f.isEmpty() )
+	if( ! f.isEmpty() && open( f ) )
 	{
-		QFile file( f );
-		if( file.open( QFile::ReadOnly ) )
-		{
-			m_filename = f;
-			m_ui->sourceEdit->setPlainText( QString::fromLocal8Bit( file.readAll() ) );
-			m_ui->sourceEdit->document()->clearUndoRedoStacks();
-
-			s.setValue( QLatin1String( "file_lua" ), QFileInfo( f ).absoluteDir().path() );
-
-			emit saved();
-			emit filename( f );
-		}
+		s.setValue( QLatin1String( "file_lua" ), QFileInfo( f ).absoluteDir().path() );
 	}
 }
 
@@ -127,29 +545,18 @@ void LuaForm::on_buttonSaveAs_clicked()
 	f = QFileDialog::getSaveFileName( this, QLatin1String( "Save File" ), f, QLatin1String( "*.lua" ) );
 	if( ! f.isEmpty() )
 	{
-		QFile file( f );
-		if( file.open( QFile::WriteOnly | QFile::Truncate ) )
-		{
-			m_filename = f;
-			file.write( m_ui->sourceEdit->toPlainText().toLocal8Bit() );
-			s.setValue( QLatin1String( "file_lua" ), QFileInfo( f ).absoluteDir().path() );
-
-			emit saved();
-			emit filename( f );
-		}
+		// completion is reported by the writer
+		save( f );
+		s.setValue( QLatin1String( "file_lua" ), QFileInfo( f ).absoluteDir().path() );
 	}
 }
 
 
 void LuaForm::on_buttonSave_clicked()
 {
-	QFile file( m_filename );
-	if( !m_filename.isEmpty() && file.open( QFile::WriteOnly | QFile::Truncate ) )
+	if( ! m_filename.isEmpty() )
 	{
-		file.write( m_ui->sourceEdit->toPlainText().toLocal8Bit() );
-
-		emit saved();
-		emit filename( m_filename );
+		save( m_filename );
 	}
 	else
 	{
@@ -162,7 +569,23 @@ void LuaForm::on_buttonStart_clicked()
 {
 	if( ! m_vm->isRunning() )
 	{
-		m_vm->setScript( m_ui->sourceEdit->toPlainText() );
+		// handed to the parser in pieces rather than as one string
+		if( isLargeFile() )
+		{
+			MappedSource* source = new MappedSource( m_large->file()->fileName() );
+			if( ! source->isMapped() )
+			{
+				delete source;
+				emit status( tr( "Cannot read %1" ).arg( m_large->file()->fileName() ) );
+				return;
+			}
+			m_vm->setScript( source );
+		}
+		else
+		{
+			m_vm->setScript( new DocumentSource( m_ui->sourceEdit->document() ) );
+		}
+
 		m_vm->setSearchDirs( QFileInfo( m_filename ).absoluteDir().absolutePath() );
 		m_vm->start();
 	}
@@ -174,6 +597,124 @@ void LuaForm::on_buttonStop_clicked()
 	m_vm->stop();
 }
 
+
+void LuaForm::on_buttonPause_clicked()
+{
+	if( m_vm->isPaused() )
+	{
+		m_vm->resume();
+	}
+	else
+	{
+		m_vm->pause();
+	}
+}
+
+
+void LuaForm::on_buttonStepOver_clicked()
+{
+	step( &LuaThread::stepOver );
+}
+
+
+void LuaForm::on_buttonStepInto_clicked()
+{
+	step( &LuaThread::stepInto );
+}
+
+
+void LuaForm::on_buttonStepOut_clicked()
+{
+	step( &LuaThread::stepOut );
+}
+
+
+void LuaForm::step( void ( LuaThread::*command )( void ) )
+{
+	if( m_vm->isRunning() )
+	{
+		( m_vm->*command )();
+	}
+	else
+	{
+		m_vm->pause();
+		on_buttonStart_clicked();
+	}
+}
+
+void LuaForm::on_buttonSuite_clicked()
+{
+	if( ! m_pool->isIdle() )
+	{
+		m_pool->stop();
+		return;
+	}
+
+	QSettings s;
+	s.beginGroup( QLatin1String( "lua" ) );
+
+	QStringList files = QFileDialog::getOpenFileNames( this, tr( "Run Suite" ),
+		s.value( QLatin1String( "file_lua" ), QString() ).toString(), QLatin1String( "*.lua" ) );
+
+	for( auto const& f : files )
+	{
+		if( m_pool->submitFile( f ) < 0 )
+		{
+			m_ui->outputView->append( tr( "[%1] cannot open\n" ).arg( f ) );
+		}
+	}
+
+	if( ! m_pool->isIdle() )
+	{
+		m_ui->buttonSuite->setText( tr( "Stop Suite" ) );
+	}
+}
+
+
+void LuaForm::on_buttonWarm_toggled( bool checked )
+{
+	m_vm->setWarm( checked );
+	m_ui->buttonReset->setEnabled( checked );
+
+	QSettings s;
+	s.beginGroup( QLatin1String( "lua" ) );
+	s.setValue( QLatin1String( "warm" ), checked );
+	s.endGroup();
+}
+
+
+void LuaForm::on_buttonReset_clicked()
+{
+	m_vm->reset();
+}
+
+
+void LuaForm::on_buttonProfile_toggled( bool checked )
+{
+	m_vm->setProfiling( checked );
+
+	if( ! checked )
+	{
+		m_ui->sourceEdit->clearLineHeat();
+	}
+
+	QSettings s;
+	s.beginGroup( QLatin1String( "lua" ) );
+	s.setValue( QLatin1String( "profile" ), checked );
+	s.endGroup();
+}
+
+
+void LuaForm::on_buttonSaveProfile_clicked()
+{
+	QString f = QFileDialog::getSaveFileName( this, tr( "Save Profile" ), QString(), QLatin1String( "*.folded" ) );
+	if( ! f.isEmpty() && ! LuaProfiler::writeCollapsed( m_vm->profile(), f ) )
+	{
+		emit status( tr( "Could not write %1" ).arg( f ) );
+	}
+}
+
+
 void LuaForm::on_buttonFont_clicked()
 {
 	QSettings s;
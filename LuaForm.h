@@ -6,6 +6,13 @@
 #include "LuaThread.h"
 
 class QFont;
+class LuaHighlighter;
+class LargeFileView;
+class LuaPool;
+class SyntaxChecker;
+class FindBar;
+class FileWriter;
+class EditJournal;
 
 namespace Ui {
 	class LuaForm;
@@ -27,12 +34,18 @@ class LuaForm : public QWidget
 
 		void setFont( QFont const& font );
 
+		// files of at least largeFileSize() bytes open read-only in the mapped viewer
+		bool open( QString const& filename );
+		bool isLargeFile( void ) const;
+		qint64 largeFileSize( void ) const;
+
 	signals:
 
 		void modified( void );
 		void saved( void );
 
 		void filename( QString const& );
+		void status( QString const& );
 
 	private slots:
 
@@ -42,6 +55,15 @@ class LuaForm : public QWidget
 		void on_buttonSaveAs_clicked();
 		void on_buttonStart_clicked();
 		void on_buttonStop_clicked();
+		void on_buttonPause_clicked();
+		void on_buttonStepOver_clicked();
+		void on_buttonStepInto_clicked();
+		void on_buttonStepOut_clicked();
+		void on_buttonSuite_clicked();
+		void on_buttonWarm_toggled( bool checked );
+		void on_buttonReset_clicked();
+		void on_buttonProfile_toggled( bool checked );
+		void on_buttonSaveProfile_clicked();
 
 		void on_buttonFont_clicked();
 
@@ -49,10 +71,36 @@ class LuaForm : public QWidget
 
 	private:
 
+		void save( QString const& filename );
+
+		// a debugger step, or when idle a start paused at the first line
+		void step( void ( LuaThread::*command )( void ) );
+
+		// offer to restore an edit journal, true if it was
+		bool recover( QString const& journal );
+
 		Ui::LuaForm* m_ui;
 		QString m_filename;
 
 		LuaThread* m_vm;
+		LuaPool* m_pool;
+		LuaHighlighter* m_highlighter;
+		SyntaxChecker* m_checker;
+
+		LargeFileView* m_large;
+		FindBar* m_find;
+
+		// saves in flight, and the last document revision queued
+		FileWriter* m_writer;
+		QString m_savingFile;
+		int m_savingRevision;
+
+		// bumped whenever another document replaces this one, so results
+		// of saves queued for the old one are not applied to it
+		quint32 m_generation;
+
+		EditJournal* m_journal;
+		qint64 m_largeSize;
 };
 
 #endif // LUAFORM_H
@@ -1,189 +1,552 @@
 #include "LuaHighlighter.h"
 
 #include <QDebug>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTimer>
+
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#endif
 
 namespace
 {
 	enum
 	{
-		bs_none = -1,
-		bs_quote = 1,
-		bs_comment = 2
+		chunk_blocks = 2048,	// blocks per snapshot handed to the worker
+		batch_blocks = 256,		// blocks per batch handed back
+		unknown_state = INT_MIN
+	};
+
+	// lexer output for a block, valid while the block revision matches
+	struct BlockData : public QTextBlockUserData
+	{
+		QVector<LuaLexer::Token> tokens;
+		int revision;
+		int entry;		// state of the previous block the tokens were made with
+		int state;		// state at the end of the block
 	};
+
+	BlockData* blockData( QTextBlock const& block )
+	{
+		BlockData* data = static_cast<BlockData*>( block.userData() );
+		if( data && data->revision == block.revision() )
+		{
+			return data;
+		}
+		return 0;
+	}
 }
 
-LuaHighlighter::LuaHighlighter( QTextDocument *parent )
-	: QSyntaxHighlighter( parent )
+
+struct LuaHighlighter::pi_Worker
 {
-	HighlightingRule rule;
+	struct Job
+	{
+		quint64 generation;
+		bool tail;				// part of the pass down the document
+		int first;				// block number of lines[0]
+		int entry;				// state before lines[0]
+		int dirtyTo;			// last edited block, no convergence before it
+		QVector<QString> lines;
+		QVector<int> next;		// entry state the following block was made with
+	};
+
+	struct Result
+	{
+		int entry;
+		int state;
+		QVector<LuaLexer::Token> tokens;
+	};
 
+	struct Batch
+	{
+		quint64 generation;
+		bool tail;
+		bool finished;			// last batch of the job
+		bool converged;			// blocks past this one are up to date
+		int first;
+		QVector<Result> blocks;
+	};
+
+	pi_Worker( LuaHighlighter* parent ) :
+		owner( parent ),
+		generation( 0 ),
+		quit( false ),
+		posted( false )
+	{
+		thread = std::thread( &pi_Worker::run, this );
+	}
+
+	~pi_Worker( void )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			quit = true;
+			++generation;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	// drop queued jobs and make the running one stop at the next block
+	void cancel( void )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		++generation;
+		jobs.clear();
+	}
+
+	void submit( Job& job, bool urgent )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			job.generation = generation;
+			if( urgent )
+			{
+				jobs.prepend( job );
+			}
+			else
+			{
+				jobs.append( job );
+			}
+		}
+		wake.notify_all();
+	}
+
+	QList<Batch> take( void )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		QList<Batch> out;
+		out.swap( results );
+		posted = false;
+		return out;
+	}
+
+	bool current( quint64 g )
+	{
+		return generation.load( std::memory_order_relaxed ) == g;
+	}
+
+	void post( Batch const& batch )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		results.append( batch );
+		if( ! posted )
+		{
+			posted = true;
+			QMetaObject::invokeMethod( owner, "deliver", Qt::QueuedConnection );
+		}
+	}
+
+	void run( void )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+
+		for( ;; )
+		{
+			wake.wait( lock, [this]{ return quit || ! jobs.isEmpty(); } );
+			if( quit )
+			{
+				break;
+			}
+
+			Job job = jobs.takeFirst();
+			lock.unlock();
+			process( job );
+			lock.lock();
+		}
+	}
+
+	void process( Job const& job )
+	{
+		Batch batch;
+		batch.generation = job.generation;
+		batch.tail = job.tail;
+		batch.finished = false;
+		batch.converged = false;
+		batch.first = job.first;
+
+		int state = job.entry;
+
+		for( int k = 0; k < job.lines.size(); ++k )
+		{
+			if( ! current( job.generation ) )
+			{
+				return;
+			}
+
+			Result r;
+			r.entry = state;
+			state = LuaLexer::tokenize( job.lines.at( k ), state, &r.tokens );
+			r.state = state;
+			batch.blocks.append( r );
+
+			int block = job.first + k;
+			if( job.tail && block >= job.dirtyTo && job.next.at( k ) == state )
+			{
+				batch.converged = true;
+				break;
+			}
+
+			if( batch.blocks.size() == batch_blocks && k + 1 < job.lines.size() )
+			{
+				post( batch );
+				batch.first += batch.blocks.size();
+				batch.blocks.clear();
+			}
+		}
+
+		batch.finished = true;
+		post( batch );
+	}
+
+	LuaHighlighter* owner;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<quint64> generation;
+	bool quit;
+	bool posted;
+
+	QList<Job> jobs;
+	QList<Batch> results;
+};
+
+
+LuaHighlighter::LuaHighlighter( QTextDocument *parent )
+	: QSyntaxHighlighter( parent ),
+	m_applying( false ),
+	m_blockCount( 0 ),
+	m_visibleFirst( 0 ),
+	m_visibleLast( 100 ),
+	m_dirtyFrom( INT_MAX ),
+	m_dirtyTo( -1 )
+{
 	// function calls
 	functionFormat.setForeground( Qt::blue );
-	rule.pattern = QRegExp( QLatin1String( "\\b[A-Za-z0-9_]+(?=\\()" ) );
-	rule.format = functionFormat;
-	highlightingRules.append( rule );
 
 	// keywords (from grammar)
-	QStringList keywordPatterns;
-	keywordPatterns << QLatin1String( "\\bfunction\\b" )
-				<< QLatin1String( "\\bbreak\\b" )
-				<< QLatin1String( "\\bgoto\\b" )
-				<< QLatin1String( "\\bdo\\b" )
-				<< QLatin1String( "\\bend\\b" )
-				<< QLatin1String( "\\bwhile\\b" )
-				<< QLatin1String( "\\brepeat\\b" )
-				<< QLatin1String( "\\buntil\\b" )
-				<< QLatin1String( "\\bif\\b" )
-				<< QLatin1String( "\\bthen\\b" )
-				<< QLatin1String( "\\belseif\\b" )
-				<< QLatin1String( "\\belse\\b" )
-				<< QLatin1String( "\\bfor\\b" )
-				<< QLatin1String( "\\bin\\b" )
-				<< QLatin1String( "\\blocal\\b" )
-				<< QLatin1String( "\\bor\\b" )
-				<< QLatin1String( "\\band\\b" )
-				<< QLatin1String( "\\bnot\\b" )
-				<< QLatin1String( "\\breturn\\b" );
-
 	keywordFormat.setForeground( Qt::darkBlue );
 	keywordFormat.setFontWeight( QFont::Bold );
 
-	for( auto const& pattern : keywordPatterns )
-	{
-		rule.pattern = QRegExp( pattern );
-		rule.format = keywordFormat;
-		highlightingRules.append( rule );
-	}
-
 	// numbers, boolean, nil
-	QStringList valuePatterns;
-	valuePatterns << QLatin1String( "\\bnil\\b" )
-				<< QLatin1String( "\\btrue\\b" )
-				<< QLatin1String( "\\bfalse\\b" )
-				<< QLatin1String( "\\b\\d+\\b" )
-				<< QLatin1String( "\\b\\d+.\\b" )
-				<< QLatin1String( "\\b\\d+e\\b" )
-				<< QLatin1String( "\\b\\[\\dA-Fa-F]+\\b" );
-
 	valueFormat.setForeground( Qt::red );
 	valueFormat.setFontWeight( QFont::Normal );
 
-	for( auto const& pattern : valuePatterns )
+	// quoted and long strings
+	quotationFormat.setForeground( Qt::darkGreen );
+
+	// single and multi line comments
+	singleLineCommentFormat.setForeground( QColor( Qt::darkGray ).darker( 120 ) );
+
+	m_worker = new pi_Worker( this );
+
+	m_timer = new QTimer( this );
+	m_timer->setSingleShot( true );
+	m_timer->setInterval( 20 );
+	connect( m_timer, &QTimer::timeout, this, &LuaHighlighter::schedule );
+
+	if( parent )
 	{
-		rule.pattern = QRegExp( pattern );
-		rule.format = valueFormat;
-		highlightingRules.append( rule );
+		connect( parent, &QTextDocument::contentsChange, this, &LuaHighlighter::contentsChange );
+
+		m_blockCount = parent->blockCount();
+		m_dirtyFrom = 0;
+		m_dirtyTo = m_blockCount - 1;
+		m_timer->start();
 	}
+}
 
-	// double quote "
-	quotationFormat.setForeground( Qt::darkGreen );
-	rule.pattern = QRegExp( QLatin1String( "\"[^\"]*\"" ) );
-	rule.format = quotationFormat;
-	highlightingRules.append( rule );
 
-	// single quote '
-	rule.pattern = QRegExp( QLatin1String( "\'[^\']*\'" ) );
-	rule.format = quotationFormat;
-	highlightingRules.append( rule );
+LuaHighlighter::~LuaHighlighter()
+{
+	delete m_worker;
+}
 
-	// multi line string [[ ]]
-	quoteStartExpression = QRegExp( QLatin1String( "\\[\\[" ) ); // --[[
-	quoteEndExpression = QRegExp( QLatin1String( "\\]\\]" ) ); // ]]
 
-	// single line comments
-	singleLineCommentFormat.setForeground( QColor( Qt::darkGray ).darker( 120 ) );
-	rule.pattern = QRegExp( QLatin1String( "--[^\n]*") );
-	rule.format = singleLineCommentFormat;
-	highlightingRules.append( rule );
+QTextCharFormat const* LuaHighlighter::format( LuaLexer::TokenType type ) const
+{
+	switch( type )
+	{
+		case LuaLexer::Keyword:		return &keywordFormat;
+		case LuaLexer::Value:		return &valueFormat;
+		case LuaLexer::String:		return &quotationFormat;
+		case LuaLexer::Comment:		return &singleLineCommentFormat;
+		case LuaLexer::Function:	return &functionFormat;
+		default:					return 0;
+	}
+}
+
 
-	//Multi Line Comment --[[ ]]
-	commentStartExpression = QRegExp( QLatin1String( "--\\[\\[" ) ); // --[[
-	commentEndExpression = QRegExp( QLatin1String( "\\]\\]" ) ); // ]]
+void LuaHighlighter::applyTokens( QVector<LuaLexer::Token> const& list )
+{
+	int length = currentBlock().length();
 
-	rule.pattern.setMinimal(false);
+	for( auto const& token : list )
+	{
+		QTextCharFormat const* f = format( token.type );
+		if( f && token.start < length )
+		{
+			setFormat( token.start, token.length, *f );
+		}
+	}
+}
+
+
+bool LuaHighlighter::isVisible( int block ) const
+{
+	return block >= m_visibleFirst && block <= m_visibleLast;
 }
 
+
 void LuaHighlighter::highlightBlock(const QString &text)
 {
-	for( auto const& rule : highlightingRules )
+	QTextBlock block = currentBlock();
+	BlockData* data = blockData( block );
+	int prev = previousBlockState();
+
+	// worker results (or an earlier pass) still apply
+	if( data && data->entry == prev )
+	{
+		applyTokens( data->tokens );
+		setCurrentBlockState( data->state );
+		return;
+	}
+
+	// what the user is looking at is lexed right away
+	if( isVisible( block.blockNumber() ) )
 	{
-		QRegExp expression( rule.pattern );
-		int index = expression.indexIn( text );
-		while( index >= 0 )
+		tokens.clear();
+		int state = LuaLexer::tokenize( text, prev, &tokens );
+
+		if( data == 0 )
 		{
-			int length = expression.matchedLength();
-			setFormat( index, length, rule.format );
-			index = expression.indexIn( text, index + length );
+			data = static_cast<BlockData*>( block.userData() );
+			if( data == 0 )
+			{
+				data = new BlockData;
+				setCurrentBlockUserData( data );
+			}
 		}
+
+		data->tokens = tokens;
+		data->revision = block.revision();
+		data->entry = prev;
+		data->state = state;
+
+		applyTokens( tokens );
+		setCurrentBlockState( state );
+		return;
 	}
 
-	setCurrentBlockState( bs_none );
+	// Elsewhere keep what we have until the worker catches up. Leaving the
+	// block state untouched stops the highlighter cascading down the document.
+	if( data )
+	{
+		applyTokens( data->tokens );
+	}
+}
 
-	//
-	// multi-line strings
-	//
 
-	int start = -1;
-	int prev = previousBlockState();
+void LuaHighlighter::contentsChange( int position, int removed, int added )
+{
+	Q_UNUSED( removed );
 
-	if( prev == bs_quote )
+	// format updates from applying worker results
+	if( m_applying )
 	{
-		start = 0;
+		return;
 	}
-	if( prev == bs_none )
+
+	QTextDocument* doc = document();
+	int count = doc->blockCount();
+	int delta = count - m_blockCount;
+	m_blockCount = count;
+
+	int from = doc->findBlock( position ).blockNumber();
+	int to = doc->findBlock( position + added ).blockNumber();
+	if( to < 0 )
 	{
-		start = quoteStartExpression.indexIn( text );
+		to = count - 1;
 	}
 
-	while( start >= 0 )
+	// shift the pending range past the edit
+	if( m_dirtyTo >= 0 && from <= m_dirtyTo )
 	{
-		int end = quoteEndExpression.indexIn( text, start );
-		int length;
+		m_dirtyTo = qMax( from, m_dirtyTo + delta );
+	}
 
-		if( end == -1 )
-		{
-			setCurrentBlockState( bs_quote );
-			length = text.length() - start;
-		}
-		else
+	m_dirtyFrom = qMin( m_dirtyFrom, qMax( 0, from ) );
+	m_dirtyTo = qMax( m_dirtyTo, to );
+
+	m_worker->cancel();
+	m_timer->start();
+}
+
+
+void LuaHighlighter::setVisibleBlocks( int first, int last )
+{
+	m_visibleFirst = first;
+	m_visibleLast = last;
+
+	// only bother the worker if something in view is not highlighted yet
+	QTextBlock block = document()->findBlockByNumber( first );
+	for( int n = first; n <= last && block.isValid(); ++n, block = block.next() )
+	{
+		if( blockData( block ) == 0 )
 		{
-			length = end - start + quoteEndExpression.matchedLength();
+			m_timer->start();
+			return;
 		}
+	}
+}
+
+
+void LuaHighlighter::schedule( void )
+{
+	m_worker->cancel();
+
+	submitViewport();
+
+	if( m_dirtyFrom <= m_dirtyTo )
+	{
+		QTextBlock prev = document()->findBlockByNumber( m_dirtyFrom - 1 );
+		submitTail( m_dirtyFrom, prev.isValid() ? prev.userState() : int( LuaLexer::NormalState ) );
+	}
+}
+
+
+void LuaHighlighter::submitViewport( void )
+{
+	QTextBlock block = document()->findBlockByNumber( m_visibleFirst );
+	if( ! block.isValid() )
+	{
+		return;
+	}
+
+	pi_Worker::Job job;
+	job.tail = false;
+	job.first = m_visibleFirst;
+	job.dirtyTo = INT_MAX;
+
+	QTextBlock prev = block.previous();
+	job.entry = prev.isValid() ? prev.userState() : int( LuaLexer::NormalState );
+
+	bool needed = false;
+	for( int n = m_visibleFirst; n <= m_visibleLast && block.isValid(); ++n, block = block.next() )
+	{
+		needed = needed || ( blockData( block ) == 0 );
+		job.lines.append( block.text() );
+		job.next.append( unknown_state );
+	}
 
-		setFormat( start, length, quotationFormat );
-		start = quoteStartExpression.indexIn( text, start + length );
+	if( needed )
+	{
+		m_worker->submit( job, true );
 	}
+}
 
-	//
-	// multi-line comments
-	//
 
-	start = -1;
-	if( prev == bs_comment )
+void LuaHighlighter::submitTail( int first, int entry )
+{
+	QTextBlock block = document()->findBlockByNumber( first );
+	if( ! block.isValid() )
 	{
-		start = 0;
+		m_dirtyFrom = INT_MAX;
+		m_dirtyTo = -1;
+		return;
 	}
-	if( prev == bs_none )
+
+	pi_Worker::Job job;
+	job.tail = true;
+	job.first = first;
+	job.entry = entry;
+	job.dirtyTo = m_dirtyTo;
+	job.lines.reserve( chunk_blocks );
+	job.next.reserve( chunk_blocks );
+
+	for( int n = 0; n < chunk_blocks && block.isValid(); ++n )
 	{
-		start = commentStartExpression.indexIn( text );
+		job.lines.append( block.text() );
+
+		block = block.next();
+		BlockData* data = block.isValid() ? blockData( block ) : 0;
+		job.next.append( data ? data->entry : int( unknown_state ) );
 	}
 
-	while( start >= 0 )
+	m_worker->submit( job, false );
+}
+
+
+void LuaHighlighter::deliver( void )
+{
+	QList<pi_Worker::Batch> batches = m_worker->take();
+
+	for( auto const& batch : batches )
 	{
-		int end = commentEndExpression.indexIn( text, start );
-		int length;
+		// anything from before the last edit is stale
+		if( ! m_worker->current( batch.generation ) )
+		{
+			continue;
+		}
+
+		QTextBlock block = document()->findBlockByNumber( batch.first );
 
-		if( end == -1 )
+		m_applying = true;
+		for( auto const& r : batch.blocks )
 		{
-			setCurrentBlockState( bs_comment );
-			length = text.length() - start;
+			if( ! block.isValid() )
+			{
+				break;
+			}
+
+			BlockData* data = static_cast<BlockData*>( block.userData() );
+			if( data == 0 )
+			{
+				data = new BlockData;
+				block.setUserData( data );
+			}
+
+			data->tokens = r.tokens;
+			data->revision = block.revision();
+			data->entry = r.entry;
+			data->state = r.state;
+
+			rehighlightBlock( block );
+			block = block.next();
 		}
-		else
+		m_applying = false;
+
+		if( ! batch.tail )
 		{
-			length = end - start + commentEndExpression.matchedLength();
+			continue;
 		}
 
-		setFormat( start, length, singleLineCommentFormat );
-		start = commentStartExpression.indexIn( text, start + length );
+		// everything before here is confirmed
+		int next = batch.first + batch.blocks.size();
+		m_dirtyFrom = next;
+
+		if( batch.finished )
+		{
+			if( batch.converged || next >= document()->blockCount() )
+			{
+				m_dirtyFrom = INT_MAX;
+				m_dirtyTo = -1;
+			}
+			else
+			{
+				submitTail( next, batch.blocks.isEmpty() ? int( LuaLexer::NormalState ) : batch.blocks.last().state );
+			}
+		}
 	}
 }
@@ -4,36 +4,66 @@
 #include <QSyntaxHighlighter>
 #include <QTextCharFormat>
 
+#include "LuaLexer.h"
+
 class QTextDocument;
+class QTimer;
 
+// Highlights on a worker thread against snapshots of the document.
+//
+// Edits are lexed synchronously only for the visible blocks; everything else
+// (including multi-line state changes cascading down the document) is done in
+// the background, viewport first, and applied in batches. Work in flight is
+// cancelled as soon as the document changes again.
 class LuaHighlighter : public QSyntaxHighlighter
 {
 	Q_OBJECT
 
+	struct pi_Worker;
+
 	public:
 		LuaHighlighter(QTextDocument *parent = 0);
+		~LuaHighlighter();
+
+	public slots:
+		// blocks currently shown by the editor, highlighted first
+		void setVisibleBlocks( int first, int last );
 
 	protected:
 		void highlightBlock(const QString &text) Q_DECL_OVERRIDE;
 
+	private slots:
+		void contentsChange( int position, int removed, int added );
+		void schedule( void );
+		void deliver( void );
+
 	private:
-		struct HighlightingRule
-		{
-			QRegExp pattern;
-			QTextCharFormat format;
-		};
-		QVector<HighlightingRule> highlightingRules;
-
-		QRegExp commentStartExpression;
-		QRegExp commentEndExpression;
-		QRegExp quoteStartExpression;
-		QRegExp quoteEndExpression;
+		QTextCharFormat const* format( LuaLexer::TokenType type ) const;
+		void applyTokens( QVector<LuaLexer::Token> const& list );
+		bool isVisible( int block ) const;
+		void submitViewport( void );
+		void submitTail( int first, int entry );
+
+		// reused between blocks to avoid reallocating
+		QVector<LuaLexer::Token> tokens;
 
 		QTextCharFormat keywordFormat;
 		QTextCharFormat valueFormat;
 		QTextCharFormat singleLineCommentFormat;
 		QTextCharFormat quotationFormat;
 		QTextCharFormat functionFormat;
+
+		pi_Worker* m_worker;
+		QTimer* m_timer;
+
+		bool m_applying;
+		int m_blockCount;
+		int m_visibleFirst;
+		int m_visibleLast;
+
+		// range of blocks not yet confirmed by the worker
+		int m_dirtyFrom;
+		int m_dirtyTo;
 };
 
 #endif // LUAHIGHLIGHTER_H
@@ -0,0 +1,421 @@
+#include "LuaLexer.h"
+
+namespace
+{
+	// block state layout: low two bits are the construct, the rest its detail
+	enum
+	{
+		st_long_string = 1,		// detail: bracket level
+		st_long_comment = 2,	// detail: bracket level
+		st_short_string = 3		// detail: 0 for ", 1 for '
+	};
+
+	inline int makeState( int kind, int detail )
+	{
+		return kind | ( detail << 2 );
+	}
+
+	inline bool isIdentStart( ushort c )
+	{
+		return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || c == '_';
+	}
+
+	inline bool isDigit( ushort c )
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline bool isIdent( ushort c )
+	{
+		return isIdentStart( c ) || isDigit( c );
+	}
+
+	inline bool isHexDigit( ushort c )
+	{
+		return isDigit( c ) || ( c >= 'a' && c <= 'f' ) || ( c >= 'A' && c <= 'F' );
+	}
+
+	inline ushort at( QChar const* text, int length, int i )
+	{
+		return i < length ? text[i].unicode() : 0;
+	}
+
+	//
+	// keywords: (2*length + first + 30*last) mod 64 is collision free for the
+	// 22 reserved words of Lua 5.3
+	//
+
+	inline int keywordHash( int length, ushort first, ushort last )
+	{
+		return ( 2 * length + first + 30 * last ) & 63;
+	}
+
+	struct KeywordTable
+	{
+		char const* words[64];
+		LuaLexer::KeywordId ids[64];
+
+		KeywordTable( void )
+		{
+			static char const* const names[] =
+			{
+				"and", "break", "do", "else", "elseif", "end", "false", "for",
+				"function", "goto", "if", "in", "local", "nil", "not", "or",
+				"repeat", "return", "then", "true", "until", "while"
+			};
+
+			for( int i = 0; i < 64; ++i )
+			{
+				words[i] = 0;
+				ids[i] = LuaLexer::NoKeyword;
+			}
+
+			for( int i = 0; i < int( sizeof(names) / sizeof(names[0]) ); ++i )
+			{
+				int length = int( qstrlen( names[i] ) );
+				int h = keywordHash( length, names[i][0], names[i][length - 1] );
+				Q_ASSERT( words[h] == 0 );
+				words[h] = names[i];
+				ids[h] = LuaLexer::KeywordId( LuaLexer::And + i );
+			}
+		}
+	};
+
+	KeywordTable const keywords;
+
+	// length of a long bracket opener "[==[" at i, 0 if there is none
+	int longBracket( QChar const* text, int length, int i, int* level )
+	{
+		if( at( text, length, i ) != '[' )
+		{
+			return 0;
+		}
+
+		int j = i + 1;
+		while( at( text, length, j ) == '=' )
+		{
+			++j;
+		}
+
+		if( at( text, length, j ) != '[' )
+		{
+			return 0;
+		}
+
+		*level = j - i - 1;
+		return j - i + 1;
+	}
+
+	// position just past the closing bracket of the given level, -1 if the
+	// line ends first
+	int closeLongBracket( QChar const* text, int length, int i, int level )
+	{
+		for( ; i < length; ++i )
+		{
+			if( text[i].unicode() != ']' )
+			{
+				continue;
+			}
+
+			int j = i + 1;
+			while( j < length && text[j].unicode() == '=' )
+			{
+				++j;
+			}
+
+			if( j - i - 1 == level && at( text, length, j ) == ']' )
+			{
+				return j + 1;
+			}
+		}
+
+		return -1;
+	}
+
+	// position just past the closing quote, -1 if the line ends first; an
+	// escaped line end keeps the string open (*open set)
+	int closeShortString( QChar const* text, int length, int i, ushort quote, bool* open )
+	{
+		*open = false;
+
+		while( i < length )
+		{
+			ushort c = text[i].unicode();
+
+			if( c == '\\' )
+			{
+				if( i + 1 >= length )
+				{
+					*open = true;
+					return -1;
+				}
+
+				// \z skips the following whitespace, including line ends
+				if( text[i + 1].unicode() == 'z' )
+				{
+					i += 2;
+					while( i < length && text[i].isSpace() )
+					{
+						++i;
+					}
+					if( i >= length )
+					{
+						*open = true;
+						return -1;
+					}
+					continue;
+				}
+
+				i += 2;
+				continue;
+			}
+
+			if( c == quote )
+			{
+				return i + 1;
+			}
+
+			++i;
+		}
+
+		return -1;
+	}
+
+	int scanNumber( QChar const* text, int length, int i )
+	{
+		if( at( text, length, i ) == '0' && ( at( text, length, i + 1 ) | 0x20 ) == 'x' )
+		{
+			i += 2;
+			while( isHexDigit( at( text, length, i ) ) || at( text, length, i ) == '.' )
+			{
+				++i;
+			}
+			if( ( at( text, length, i ) | 0x20 ) == 'p' )
+			{
+				++i;
+				if( at( text, length, i ) == '+' || at( text, length, i ) == '-' )
+				{
+					++i;
+				}
+				while( isDigit( at( text, length, i ) ) )
+				{
+					++i;
+				}
+			}
+			return i;
+		}
+
+		while( isDigit( at( text, length, i ) ) || at( text, length, i ) == '.' )
+		{
+			++i;
+		}
+		if( ( at( text, length, i ) | 0x20 ) == 'e' )
+		{
+			++i;
+			if( at( text, length, i ) == '+' || at( text, length, i ) == '-' )
+			{
+				++i;
+			}
+			while( isDigit( at( text, length, i ) ) )
+			{
+				++i;
+			}
+		}
+		return i;
+	}
+
+	inline void push( QVector<LuaLexer::Token>* tokens, int start, int length, LuaLexer::TokenType type,
+					  LuaLexer::KeywordId keyword = LuaLexer::NoKeyword, ushort bracket = 0 )
+	{
+		if( tokens )
+		{
+			LuaLexer::Token token = { start, length, type, keyword, bracket };
+			tokens->append( token );
+		}
+	}
+}
+
+
+LuaLexer::KeywordId LuaLexer::keyword( QChar const* word, int length )
+{
+	if( length < 2 || length > 8 )
+	{
+		return NoKeyword;
+	}
+
+	int h = keywordHash( length, word[0].unicode(), word[length - 1].unicode() );
+	char const* candidate = keywords.words[h];
+	if( candidate == 0 )
+	{
+		return NoKeyword;
+	}
+
+	for( int i = 0; i < length; ++i )
+	{
+		if( candidate[i] != word[i].unicode() )
+		{
+			return NoKeyword;
+		}
+	}
+
+	return candidate[length] == 0 ? keywords.ids[h] : NoKeyword;
+}
+
+
+int LuaLexer::tokenize( QString const& text, int state, QVector<Token>* tokens )
+{
+	return tokenize( text.constData(), text.length(), state, tokens );
+}
+
+
+int LuaLexer::tokenize( QChar const* text, int length, int state, QVector<Token>* tokens )
+{
+	int i = 0;
+
+	//
+	// finish whatever the previous line left open
+	//
+
+	if( state > 0 )
+	{
+		int kind = state & 3;
+		int detail = state >> 2;
+
+		if( kind == st_short_string )
+		{
+			bool open;
+			int end = closeShortString( text, length, 0, detail ? '\'' : '"', &open );
+			if( end < 0 )
+			{
+				push( tokens, 0, length, String );
+				return open ? state : NormalState;
+			}
+
+			push( tokens, 0, end, String );
+			i = end;
+		}
+		else
+		{
+			int end = closeLongBracket( text, length, 0, detail );
+			TokenType type = ( kind == st_long_comment ) ? Comment : String;
+			if( end < 0 )
+			{
+				push( tokens, 0, length, type );
+				return state;
+			}
+
+			push( tokens, 0, end, type );
+			i = end;
+		}
+	}
+
+	//
+	// main scan
+	//
+
+	while( i < length )
+	{
+		ushort c = text[i].unicode();
+
+		// names, keywords, values and function calls
+		if( isIdentStart( c ) )
+		{
+			int start = i;
+			while( ++i < length && isIdent( text[i].unicode() ) )
+			{
+			}
+
+			KeywordId id = keyword( text + start, i - start );
+			if( id == Nil || id == True || id == False )
+			{
+				push( tokens, start, i - start, Value, id );
+			}
+			else if( id != NoKeyword )
+			{
+				push( tokens, start, i - start, Keyword, id );
+			}
+			else if( at( text, length, i ) == '(' )
+			{
+				push( tokens, start, i - start, Function );
+			}
+			continue;
+		}
+
+		// numbers
+		if( isDigit( c ) || ( c == '.' && isDigit( at( text, length, i + 1 ) ) ) )
+		{
+			int start = i;
+			i = scanNumber( text, length, i );
+			push( tokens, start, i - start, Value );
+			continue;
+		}
+
+		// comments
+		if( c == '-' && at( text, length, i + 1 ) == '-' )
+		{
+			int level;
+			int open = longBracket( text, length, i + 2, &level );
+			if( open > 0 )
+			{
+				int end = closeLongBracket( text, length, i + 2 + open, level );
+				if( end < 0 )
+				{
+					push( tokens, i, length - i, Comment );
+					return makeState( st_long_comment, level );
+				}
+
+				push( tokens, i, end - i, Comment );
+				i = end;
+				continue;
+			}
+
+			push( tokens, i, length - i, Comment );
+			return NormalState;
+		}
+
+		// quoted strings
+		if( c == '"' || c == '\'' )
+		{
+			bool open;
+			int end = closeShortString( text, length, i + 1, c, &open );
+			if( end < 0 )
+			{
+				push( tokens, i, length - i, String );
+				return open ? makeState( st_short_string, c == '\'' ? 1 : 0 ) : NormalState;
+			}
+
+			push( tokens, i, end - i, String );
+			i = end;
+			continue;
+		}
+
+		// long strings and brackets
+		if( c == '[' )
+		{
+			int level;
+			int open = longBracket( text, length, i, &level );
+			if( open > 0 )
+			{
+				int end = closeLongBracket( text, length, i + open, level );
+				if( end < 0 )
+				{
+					push( tokens, i, length - i, String );
+					return makeState( st_long_string, level );
+				}
+
+				push( tokens, i, end - i, String );
+				i = end;
+				continue;
+			}
+		}
+
+		if( c == '(' || c == ')' || c == '{' || c == '}' || c == '[' || c == ']' )
+		{
+			push( tokens, i, 1, Bracket, NoKeyword, c );
+		}
+
+		++i;
+	}
+
+	return NormalState;
+}
@@ -0,0 +1,60 @@
+#ifndef LUALEXER_H
+#define LUALEXER_H
+
+#include <QString>
+#include <QVector>
+
+
+// Single pass Lua tokenizer, one line (text block) at a time.
+//
+// Only the tokens the editor cares about are produced: keywords, values,
+// strings, comments, function call names and brackets. Constructs that
+// continue onto the next line (long strings/comments, escaped newlines in
+// short strings) are carried over in an integer state compatible with
+// QSyntaxHighlighter block states; -1 means "nothing open".
+class LuaLexer
+{
+	public:
+
+		enum TokenType
+		{
+			Keyword,
+			Value,			// nil, true, false and numbers
+			String,			// quoted and long strings
+			Comment,
+			Function,		// name immediately followed by '('
+			Bracket			// ( ) { } [ ]
+		};
+
+		enum KeywordId
+		{
+			NoKeyword = 0,
+			And, Break, Do, Else, Elseif, End, False, For, Function_,
+			Goto, If, In, Local, Nil, Not, Or, Repeat, Return, Then,
+			True, Until, While
+		};
+
+		struct Token
+		{
+			int start;
+			int length;
+			TokenType type;
+			KeywordId keyword;	// for Keyword and Value tokens
+			ushort bracket;		// for Bracket tokens, the character
+		};
+
+		enum
+		{
+			NormalState = -1
+		};
+
+		// Appends the tokens of one line to tokens (when given) and returns the
+		// state at the end of the line.
+		static int tokenize( QChar const* text, int length, int state, QVector<Token>* tokens );
+		static int tokenize( QString const& text, int state, QVector<Token>* tokens );
+
+		// perfect hash lookup, NoKeyword when the word is not reserved
+		static KeywordId keyword( QChar const* word, int length );
+};
+
+#endif // LUALEXER_H
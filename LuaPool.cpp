@@ -0,0 +1,317 @@
+#include "LuaPool.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QThread>
+#include <QMetaMethod>
+
+#include <algorithm>
+
+
+LuaPool::LuaPool( QObject* parent ) :
+	QObject( parent ),
+	m_size( qMax( 1, QThread::idealThreadCount() ) ),
+	m_warm( false ),
+	m_memoryLimit( 0 ),
+	m_caching( true ),
+	m_nextId( 1 )
+{
+}
+
+
+LuaPool::~LuaPool( void )
+{
+	m_queue.clear();
+
+	// LuaThread's destructor stops and joins its worker
+	for( auto& worker : m_workers )
+	{
+		delete worker.vm;
+	}
+}
+
+
+void LuaPool::setWorkers( int n )
+{
+	m_size = qMax( 1, n );
+
+	if( isIdle() )
+	{
+		resize();
+	}
+}
+
+
+int LuaPool::workers( void ) const
+{
+	return m_size;
+}
+
+
+void LuaPool::setWarm( bool warm )
+{
+	m_warm = warm;
+
+	for( auto& worker : m_workers )
+	{
+		worker.vm->setWarm( warm );
+	}
+}
+
+
+void LuaPool::setMemoryLimit( quint64 bytes )
+{
+	m_memoryLimit = bytes;
+
+	for( auto& worker : m_workers )
+	{
+		worker.vm->setMemoryLimit( bytes );
+	}
+}
+
+
+void LuaPool::setBudget( LuaThread::Budget const& budget )
+{
+	m_budget = budget;
+
+	for( auto& worker : m_workers )
+	{
+		worker.vm->setBudget( budget );
+	}
+}
+
+
+void LuaPool::setBytecodeCache( bool enable )
+{
+	m_caching = enable;
+
+	for( auto& worker : m_workers )
+	{
+		worker.vm->setBytecodeCache( enable );
+	}
+}
+
+
+int LuaPool::submit( QString const& name, QString const& script, QStringList const& searchdirs )
+{
+	if( isIdle() )
+	{
+		// a new batch
+		m_summary = Summary();
+		m_latencies.clear();
+		m_clock.start();
+		resize();
+	}
+
+	Job job;
+	job.id = m_nextId++;
+	job.name = name;
+	job.script = script;
+	job.searchdirs = searchdirs;
+	job.submitted = m_clock.elapsed();
+	m_queue.append( job );
+
+	dispatch();
+	return job.id;
+}
+
+
+int LuaPool::submitFile( QString const& filename, QStringList const& searchdirs )
+{
+	QFile file( filename );
+	if( ! file.open( QFile::ReadOnly ) )
+	{
+		return -1;
+	}
+
+	QFileInfo info( filename );
+	QStringList dirs;
+	dirs << info.absoluteDir().absolutePath();
+	dirs << searchdirs;
+
+	return submit( info.fileName(), QString::fromLocal8Bit( file.readAll() ), dirs );
+}
+
+
+bool LuaPool::isIdle( void ) const
+{
+	if( ! m_queue.isEmpty() )
+	{
+		return false;
+	}
+
+	for( auto const& worker : m_workers )
+	{
+		if( worker.busy )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+LuaPool::Summary LuaPool::summary( void ) const
+{
+	return m_summary;
+}
+
+
+void LuaPool::stop( void )
+{
+	m_queue.clear();
+
+	for( auto& worker : m_workers )
+	{
+		if( worker.busy )
+		{
+			worker.vm->stop();
+		}
+	}
+}
+
+
+void LuaPool::resize( void )
+{
+	while( m_workers.size() > m_size )
+	{
+		delete m_workers.takeLast().vm;
+	}
+
+	while( m_workers.size() < m_size )
+	{
+		int index = m_workers.size();
+
+		Worker worker;
+		worker.vm = new LuaThread;
+		worker.vm->setTrackingMode( LuaThread::NoTracking );
+		worker.vm->setWarm( m_warm );
+		worker.vm->setMemoryLimit( m_memoryLimit );
+		worker.vm->setBytecodeCache( m_caching );
+		worker.vm->setBudget( m_budget );
+		worker.busy = false;
+
+		connect( worker.vm, &LuaThread::fromStdOut, this, [this, index]( QString const& text ){
+			output( index, text );
+		} );
+		connect( worker.vm, &LuaThread::stopped, this, [this, index]{
+			done( index );
+		} );
+
+		m_workers.append( worker );
+	}
+}
+
+
+void LuaPool::dispatch( void )
+{
+	for( int i = 0; i < m_workers.size() && ! m_queue.isEmpty(); ++i )
+	{
+		Worker& worker = m_workers[i];
+		if( worker.busy )
+		{
+			continue;
+		}
+
+		worker.job = m_queue.takeFirst();
+		worker.busy = true;
+		worker.partial.clear();
+
+		worker.vm->setSearchDirs( worker.job.searchdirs );
+		worker.vm->setChunkName( worker.job.name );
+		worker.vm->setScript( worker.job.script );
+		worker.job.script.clear();
+
+		emit jobStarted( worker.job.id, worker.job.name );
+		worker.vm->start();
+	}
+}
+
+
+void LuaPool::output( int index, QString const& text )
+{
+	Worker& worker = m_workers[index];
+	worker.partial += text;
+
+	int end = worker.partial.lastIndexOf( QLatin1Char( '\n' ) );
+	if( end >= 0 )
+	{
+		QString lines = worker.partial.left( end + 1 );
+		worker.partial.remove( 0, end + 1 );
+		deliver( worker, lines );
+	}
+}
+
+
+// lines is one or more whole lines, each ending in a newline
+void LuaPool::deliver( Worker const& worker, QString const& lines )
+{
+	emit jobOutput( worker.job.id, lines );
+
+	static QMetaMethod const tagged = QMetaMethod::fromSignal( &LuaPool::jobTaggedOutput );
+	if( ! isSignalConnected( tagged ) )
+	{
+		return;
+	}
+
+	QString tag = QLatin1Char( '[' ) + worker.job.name + QLatin1String( "] " );
+	QString text;
+	for( int start = 0; start < lines.size(); )
+	{
+		int end = lines.indexOf( QLatin1Char( '\n' ), start ) + 1;
+		text += tag;
+		text += lines.midRef( start, end - start );
+		start = end;
+	}
+	emit jobTaggedOutput( worker.job.id, text );
+}
+
+
+void LuaPool::done( int index )
+{
+	Worker& worker = m_workers[index];
+	if( ! worker.busy )
+	{
+		return;
+	}
+
+	// the last line may lack its newline
+	if( ! worker.partial.isEmpty() )
+	{
+		deliver( worker, worker.partial + QLatin1Char( '\n' ) );
+		worker.partial.clear();
+	}
+
+	worker.busy = false;
+
+	LuaThread::Statistics stats = worker.vm->statistics();
+	qint64 now = m_clock.elapsed();
+	double latency = ( now - worker.job.submitted ) / 1000.0;
+
+	m_summary.jobs += 1;
+	m_summary.failures += ( stats.status == LuaThread::NormalExit ) ? 0 : 1;
+	m_summary.cpuSeconds += stats.cpuSeconds;
+	m_summary.outputBytes += stats.outputBytes;
+	m_summary.peakBytes = qMax( m_summary.peakBytes, stats.peakBytes );
+	m_summary.wallSeconds = now / 1000.0;
+
+	m_latencies.append( latency );
+	m_summary.meanLatency += ( latency - m_summary.meanLatency ) / m_latencies.size();
+	m_summary.maxLatency = qMax( m_summary.maxLatency, latency );
+
+	int id = worker.job.id;
+	emit jobFinished( id, stats );
+
+	dispatch();
+
+	if( isIdle() )
+	{
+		QVector<double> sorted( m_latencies );
+		std::sort( sorted.begin(), sorted.end() );
+		m_summary.p95Latency = sorted.at( qMin( sorted.size() - 1, int( sorted.size() * 0.95 ) ) );
+
+		emit finished();
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef LUAPOOL_H
+#define LUAPOOL_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+
+#include "LuaThread.h"
+
+
+// Runs independent scripts on a fixed number of LuaThreads.
+//
+// Every worker has its own lua_State, so jobs share nothing but the queue.
+// Output is collected per job and handed on in whole lines tagged with the
+// job id, so concurrent jobs never interleave inside a line.
+class LuaPool : public QObject
+{
+	Q_OBJECT
+
+	public:
+
+		struct Summary
+		{
+			Summary( void ) :
+				jobs( 0 ),
+				failures( 0 ),
+				wallSeconds( 0 ),
+				cpuSeconds( 0 ),
+				outputBytes( 0 ),
+				peakBytes( 0 ),
+				meanLatency( 0 ),
+				p95Latency( 0 ),
+				maxLatency( 0 )
+			{
+			}
+
+			double jobsPerSecond( void ) const
+			{
+				return wallSeconds > 0 ? jobs / wallSeconds : 0;
+			}
+
+			int jobs;
+			int failures;			// jobs not ending in NormalExit
+			double wallSeconds;		// first submit to last finish
+			double cpuSeconds;		// summed over jobs
+			quint64 outputBytes;
+			quint64 peakBytes;		// largest of any job
+
+			// submit to finish, in seconds
+			double meanLatency;
+			double p95Latency;
+			double maxLatency;
+		};
+
+		explicit LuaPool( QObject* parent = 0 );
+		~LuaPool( void );
+
+		// number of vm threads, applied while idle
+		void setWorkers( int n );
+		int workers( void ) const;
+
+		void setWarm( bool warm );
+
+		// per worker, see LuaThread::setMemoryLimit
+		void setMemoryLimit( quint64 bytes );
+
+		void setBytecodeCache( bool enable );
+
+		// per job, see LuaThread::setBudget
+		void setBudget( LuaThread::Budget const& budget );
+
+		// queue a script, returns its job id
+		int submit( QString const& name, QString const& script, QStringList const& searchdirs );
+
+		// queue a file, searching its own directory first; -1 if it cannot be read
+		int submitFile( QString const& filename, QStringList const& searchdirs = QStringList() );
+
+		bool isIdle( void ) const;
+
+		// figures for the jobs finished since the pool was last idle
+		Summary summary( void ) const;
+
+	signals:
+
+		void jobStarted( int id, QString const& name );
+		void jobOutput( int id, QString const& lines );
+
+		// the same lines, each prefixed with "[name] " of the job's script
+		void jobTaggedOutput( int id, QString const& lines );
+		void jobFinished( int id, LuaThread::Statistics const& stats );
+
+		// queue drained and all workers idle
+		void finished( void );
+
+	public slots:
+
+		// drop queued jobs and stop the running ones
+		void stop( void );
+
+	private:
+
+		struct Job
+		{
+			int id;
+			QString name;
+			QString script;
+			QStringList searchdirs;
+			qint64 submitted;		// ms on m_clock
+		};
+
+		struct Worker
+		{
+			LuaThread* vm;
+			Job job;
+			bool busy;
+			QString partial;		// output after the last newline
+		};
+
+		void resize( void );
+		void dispatch( void );
+		void output( int worker, QString const& text );
+		void deliver( Worker const& worker, QString const& lines );
+		void done( int worker );
+
+		QList<Worker> m_workers;
+		QList<Job> m_queue;
+		int m_size;
+		bool m_warm;
+		quint64 m_memoryLimit;
+		bool m_caching;
+		LuaThread::Budget m_budget;
+		int m_nextId;
+
+		QElapsedTimer m_clock;
+		Summary m_summary;
+		QVector<double> m_latencies;
+};
+
+#endif // LUAPOOL_H
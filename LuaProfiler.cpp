@@ -0,0 +1,237 @@
+#include "LuaProfiler.h"
+
+#include <lua.hpp>
+
+#include <QFile>
+
+#include <chrono>
+#include <cstring>
+
+
+namespace
+{
+	void copy( char* dst, size_t n, char const* src )
+	{
+		std::strncpy( dst, src ? src : "?", n - 1 );
+		dst[n - 1] = 0;
+	}
+}
+
+
+LuaProfiler::LuaProfiler( void ) :
+	m_rate( 1000 ),
+	m_samples( 0 ),
+	m_head( 0 ),
+	m_tail( 0 ),
+	m_tick( false ),
+	m_dropped( 0 ),
+	m_quit( false )
+{
+}
+
+
+LuaProfiler::~LuaProfiler( void )
+{
+	end();
+	delete[] m_samples;
+}
+
+
+void LuaProfiler::setRate( int hz )
+{
+	m_rate = qBound( 1, hz, 10000 );
+}
+
+
+int LuaProfiler::rate( void ) const
+{
+	return m_rate;
+}
+
+
+void LuaProfiler::begin( QByteArray const& source )
+{
+	end();
+
+	// compared against short_src, which is cut to fit
+	m_source = source.left( int( sizeof(Frame::source) ) - 1 );
+
+	if( m_samples == 0 )
+	{
+		m_samples = new Sample[sample_count];
+	}
+
+	m_report = Report();
+	m_head = 0;
+	m_tail = 0;
+	m_tick = false;
+	m_dropped = 0;
+	m_quit = false;
+
+	m_thread = std::thread( &LuaProfiler::run, this );
+}
+
+
+void LuaProfiler::end( void )
+{
+	if( ! m_thread.joinable() )
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	m_tick = false;
+	m_report.dropped = m_dropped;
+}
+
+
+LuaProfiler::Report LuaProfiler::report( void ) const
+{
+	return m_report;
+}
+
+
+void LuaProfiler::capture( lua_State* L )
+{
+	m_tick.store( false, std::memory_order_relaxed );
+
+	size_t head = m_head.load( std::memory_order_relaxed );
+	if( head - m_tail.load( std::memory_order_acquire ) >= sample_count )
+	{
+		m_dropped.fetch_add( 1, std::memory_order_relaxed );
+		return;
+	}
+
+	Sample& sample = m_samples[head & ( sample_count - 1 )];
+
+	// inside a hook level 0 is the running function
+	lua_Debug ar;
+	int depth = 0;
+	for( int level = 0; depth < max_depth && lua_getstack( L, level, &ar ); ++level )
+	{
+		if( ! lua_getinfo( L, "Sln", &ar ) )
+		{
+			break;
+		}
+
+		Frame& frame = sample.frames[depth++];
+		frame.line = ar.currentline;
+		frame.defined = ar.linedefined;
+		copy( frame.source, sizeof(frame.source), ar.short_src );
+		copy( frame.name, sizeof(frame.name), ar.name ? ar.name : ( *ar.what == 'm' ? "main chunk" : "?" ) );
+	}
+	sample.depth = depth;
+
+	m_head.store( head + 1, std::memory_order_release );
+}
+
+
+void LuaProfiler::run( void )
+{
+	std::chrono::microseconds period( 1000000 / m_rate );
+
+	std::unique_lock<std::mutex> lock( m_mutex );
+	while( ! m_quit )
+	{
+		m_wake.wait_for( lock, period, [this]{ return m_quit; } );
+		m_tick.store( true, std::memory_order_relaxed );
+
+		lock.unlock();
+		drain();
+		lock.lock();
+	}
+	lock.unlock();
+
+	drain();
+}
+
+
+void LuaProfiler::drain( void )
+{
+	size_t tail = m_tail.load( std::memory_order_relaxed );
+	size_t head = m_head.load( std::memory_order_acquire );
+
+	for( ; tail != head; ++tail )
+	{
+		aggregate( m_samples[tail & ( sample_count - 1 )] );
+	}
+
+	m_tail.store( tail, std::memory_order_release );
+}
+
+
+void LuaProfiler::aggregate( Sample const& sample )
+{
+	if( sample.depth == 0 )
+	{
+		return;
+	}
+
+	++m_report.samples;
+
+	// outermost frame first
+	QByteArray key;
+	for( int i = sample.depth - 1; i >= 0; --i )
+	{
+		Frame const& frame = sample.frames[i];
+
+		QByteArray label( frame.name );
+		label += " (";
+		label += frame.source;
+		if( frame.defined > 0 )
+		{
+			label += ':';
+			label += QByteArray::number( frame.defined );
+		}
+		label += ')';
+
+		// ';' separates frames and the last space the count
+		label.replace( ';', ':' ).replace( '\n', ' ' );
+
+		if( ! key.isEmpty() )
+		{
+			key += ';';
+		}
+		key += label;
+	}
+	++m_report.stacks[key];
+
+	// charge the innermost line of the script being run, so time spent in
+	// modules and C functions lands on the line that called them
+	for( int i = 0; i < sample.depth; ++i )
+	{
+		Frame const& frame = sample.frames[i];
+		if( frame.line > 0 && m_source == frame.source )
+		{
+			++m_report.lines[frame.line];
+			break;
+		}
+	}
+}
+
+
+bool LuaProfiler::writeCollapsed( Report const& report, QString const& filename )
+{
+	QFile file( filename );
+	if( ! file.open( QFile::WriteOnly | QFile::Truncate ) )
+	{
+		return false;
+	}
+
+	for( auto it = report.stacks.constBegin(); it != report.stacks.constEnd(); ++it )
+	{
+		QByteArray line( it.key() );
+		line += ' ';
+		line += QByteArray::number( it.value() );
+		line += '\n';
+		file.write( line );
+	}
+
+	return file.error() == QFile::NoError;
+}
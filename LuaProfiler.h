@@ -0,0 +1,122 @@
+#ifndef LUAPROFILER_H
+#define LUAPROFILER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#endif
+
+struct lua_State;
+
+
+// Sampling profiler for a running vm.
+//
+// A timer thread raises a tick flag at the sampling rate; the next count
+// hook on the vm thread copies the Lua call stack into a preallocated ring
+// and clears it. The same timer thread folds the samples into collapsed
+// stacks and per line counts, so the vm never allocates while profiling.
+class LuaProfiler
+{
+	public:
+
+		struct Report
+		{
+			Report( void ) :
+				samples( 0 ),
+				dropped( 0 )
+			{
+			}
+
+			quint64 samples;
+			quint64 dropped;				// ring was full
+
+			QHash<QByteArray, quint64> stacks;	// "outer;...;inner" -> samples
+			QHash<int, quint64> lines;		// script line -> samples
+		};
+
+		LuaProfiler( void );
+		~LuaProfiler( void );
+
+		// samples per second
+		void setRate( int hz );
+		int rate( void ) const;
+
+		// vm thread: around a run, source is the chunk name lines are counted for
+		void begin( QByteArray const& source );
+		void end( void );
+
+		// vm thread: from the count hook
+		void sample( lua_State* L )
+		{
+			if( m_tick.load( std::memory_order_relaxed ) )
+			{
+				capture( L );
+			}
+		}
+
+		// results of the last run, valid once end() returned
+		Report report( void ) const;
+
+		// collapsed stack lines as read by flamegraph.pl and speedscope
+		static bool writeCollapsed( Report const& report, QString const& filename );
+
+	private:
+
+		enum
+		{
+			max_depth = 32,
+			sample_count = 1024		// power of two
+		};
+
+		struct Frame
+		{
+			int line;
+			int defined;
+			char source[48];
+			char name[32];
+		};
+
+		struct Sample
+		{
+			int depth;
+			Frame frames[max_depth];
+		};
+
+		LuaProfiler( LuaProfiler const& );
+		LuaProfiler& operator=( LuaProfiler const& );
+
+		void capture( lua_State* L );
+		void run( void );
+		void drain( void );
+		void aggregate( Sample const& sample );
+
+		int m_rate;
+		QByteArray m_source;
+		Sample* m_samples;
+
+		// ring positions, head written by the vm and tail by the timer thread
+		std::atomic<size_t> m_head;
+		std::atomic<size_t> m_tail;
+		std::atomic<bool> m_tick;
+		std::atomic<quint64> m_dropped;
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_quit;
+
+		// timer thread while running, anyone after end()
+		Report m_report;
+};
+
+#endif // LUAPROFILER_H
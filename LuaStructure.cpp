@@ -0,0 +1,475 @@
+#include "LuaStructure.h"
+
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+
+#include <climits>
+
+namespace
+{
+	enum
+	{
+		sync_blocks = 1024,		// lines relexed within contentsChange
+		chunk_blocks = 16384,	// lines relexed per idle pass after that
+		unknown_state = INT_MIN
+	};
+}
+
+
+LuaStructure::LuaStructure( QTextDocument* document ) :
+	QObject( document ),
+	m_document( document ),
+	m_revision( document->revision() ),
+	m_dirtyFrom( 0 ),
+	m_dirtyTo( document->blockCount() - 1 ),
+	m_size( 0 ),
+	m_treeFrom( INT_MAX ),
+	m_treeTo( -1 )
+{
+	Line fresh = { unknown_state, unknown_state, { 0, 0 } };
+	m_lines.fill( fresh, document->blockCount() );
+	invalidate( 0, m_lines.size() - 1 );
+
+	m_timer = new QTimer( this );
+	m_timer->setSingleShot( true );
+	m_timer->setInterval( 0 );
+	connect( m_timer, &QTimer::timeout, this, &LuaStructure::resume );
+	m_timer->start();
+
+	connect( document, &QTextDocument::contentsChange, this, &LuaStructure::contentsChange );
+}
+
+
+LuaStructure::Summary LuaStructure::combine( Summary const& a, Summary const& b )
+{
+	// a's open blocks are closed first by b's closers
+	int matched = qMin( a.open, b.close );
+	Summary s = { a.close + b.close - matched, a.open + b.open - matched };
+	return s;
+}
+
+
+LuaStructure::Summary LuaStructure::summarise( QVector<Event> const& events )
+{
+	Summary s = { 0, 0 };
+	for( auto const& e : events )
+	{
+		if( e.close )
+		{
+			if( s.open > 0 )
+			{
+				--s.open;
+			}
+			else
+			{
+				++s.close;
+			}
+		}
+		if( e.open )
+		{
+			++s.open;
+		}
+	}
+	return s;
+}
+
+
+int LuaStructure::events( QString const& text, int entry, QVector<Event>* out )
+{
+	m_tokens.clear();
+	out->clear();
+	int state = LuaLexer::tokenize( text, entry, &m_tokens );
+
+	for( auto const& t : m_tokens )
+	{
+		Event e = { t.start, t.length, false, false };
+
+		if( t.type == LuaLexer::Keyword )
+		{
+			switch( t.keyword )
+			{
+				case LuaLexer::Function_:
+				case LuaLexer::Do:
+				case LuaLexer::Then:
+				case LuaLexer::Repeat:
+					e.open = true;
+					break;
+				case LuaLexer::End:
+				case LuaLexer::Until:
+				case LuaLexer::Elseif:		// its then opens the next part
+					e.close = true;
+					break;
+				case LuaLexer::Else:
+					e.close = e.open = true;
+					break;
+				default:
+					continue;
+			}
+		}
+		else if( t.type == LuaLexer::Bracket )
+		{
+			e.open = t.bracket == '(' || t.bracket == '[' || t.bracket == '{';
+			e.close = ! e.open;
+		}
+		else
+		{
+			continue;
+		}
+
+		out->append( e );
+	}
+
+	return state;
+}
+
+
+void LuaStructure::contentsChange( int position, int removed, int added )
+{
+	// highlighting and folding report format changes, the text is the same
+	if( removed == added && m_document->revision() == m_revision )
+	{
+		return;
+	}
+	m_revision = m_document->revision();
+
+	int count = m_document->blockCount();
+	int first = m_document->findBlock( position ).blockNumber();
+	QTextBlock end = m_document->findBlock( position + added );
+	int last = end.isValid() ? end.blockNumber() : count - 1;
+
+	Line fresh = { unknown_state, unknown_state, { 0, 0 } };
+	int before = m_lines.size();
+
+	if( first < 0 || first >= before )
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	// lines first..last replace first..last-delta in the old numbering
+	int delta = count - before;
+	int old = qBound( 0, last - delta - first + 1, before - first );
+	m_lines.remove( first, old );
+	m_lines.insert( first, last - first + 1, fresh );
+
+	if( m_lines.size() != count )
+	{
+		// out of step somehow, start over
+		m_lines.clear();
+		m_lines.fill( fresh, count );
+		first = 0;
+		last = count - 1;
+		m_dirtyFrom = INT_MAX;
+		m_dirtyTo = -1;
+	}
+
+	// everything after the edit moved unless the line count stayed the same
+	invalidate( first, delta == 0 ? last : qMax( before, count ) - 1 );
+
+	// shift the pending range past the edit
+	if( m_dirtyTo >= 0 && first <= m_dirtyTo )
+	{
+		m_dirtyTo = qMax( first, m_dirtyTo + delta );
+	}
+	m_dirtyFrom = qMin( m_dirtyFrom, first );
+	m_dirtyTo = qMax( m_dirtyTo, last );
+
+	lex( sync_blocks );
+}
+
+
+void LuaStructure::resume( void )
+{
+	lex( chunk_blocks );
+}
+
+
+// Lexes pending lines from m_dirtyFrom, until past m_dirtyTo a line was
+// already lexed with the state it now follows (everything below is as it
+// was), or the budget runs out and the rest is left for the timer.
+void LuaStructure::lex( int budget )
+{
+	if( m_dirtyFrom > m_dirtyTo )
+	{
+		return;
+	}
+
+	int n = m_dirtyFrom;
+	int entry = n > 0 ? m_lines.at( n - 1 ).state : int( LuaLexer::NormalState );
+	bool changed = false;
+	bool finished = true;
+
+	for( QTextBlock block = m_document->findBlockByNumber( n ); block.isValid() && n < m_lines.size(); block = block.next(), ++n )
+	{
+		Line& line = m_lines[n];
+		if( n > m_dirtyTo && line.entry == entry )
+		{
+			break;
+		}
+
+		if( budget-- == 0 )
+		{
+			finished = false;
+			break;
+		}
+
+		Summary before = line.summary;
+		line.entry = entry;
+		line.state = events( block.text(), entry, &m_events );
+		line.summary = summarise( m_events );
+		entry = line.state;
+
+		if( line.summary.close != before.close || line.summary.open != before.open )
+		{
+			invalidate( n, n );
+			changed = changed || ( line.summary.open > 0 ) != ( before.open > 0 );
+		}
+	}
+
+	if( finished )
+	{
+		m_dirtyFrom = INT_MAX;
+		m_dirtyTo = -1;
+	}
+	else
+	{
+		// a cascade past the edit carries on from here next time too
+		m_dirtyFrom = n;
+		m_dirtyTo = qMax( m_dirtyTo, n );
+		m_timer->start();
+	}
+
+	if( changed )
+	{
+		emit updated();
+	}
+}
+
+
+void LuaStructure::invalidate( int from, int to )
+{
+	m_treeFrom = qMin( m_treeFrom, from );
+	m_treeTo = qMax( m_treeTo, to );
+}
+
+
+void LuaStructure::refresh( void )
+{
+	int count = m_lines.size();
+	if( m_size < count )
+	{
+		m_size = 1;
+		while( m_size < count )
+		{
+			m_size *= 2;
+		}
+
+		Summary empty = { 0, 0 };
+		m_tree.fill( empty, 2 * m_size );
+		m_treeFrom = 0;
+		m_treeTo = count - 1;
+	}
+
+	int from = qMax( 0, m_treeFrom );
+	int to = qMin( m_treeTo, m_size - 1 );
+	if( from > to )
+	{
+		return;
+	}
+
+	for( int k = from; k <= to; ++k )
+	{
+		Summary empty = { 0, 0 };
+		m_tree[m_size + k] = k < count ? m_lines.at( k ).summary : empty;
+	}
+
+	for( int lo = ( m_size + from ) / 2, hi = ( m_size + to ) / 2; lo > 0; lo /= 2, hi /= 2 )
+	{
+		for( int i = lo; i <= hi; ++i )
+		{
+			m_tree[i] = combine( m_tree.at( 2 * i ), m_tree.at( 2 * i + 1 ) );
+		}
+	}
+
+	m_treeFrom = INT_MAX;
+	m_treeTo = -1;
+}
+
+
+// First line from `from` on where `need` more blocks are closed than opened.
+int LuaStructure::forward( int node, int lo, int hi, int from, int& need ) const
+{
+	if( hi < from )
+	{
+		return -1;
+	}
+
+	Summary const& s = m_tree.at( node );
+	if( lo >= from && s.close < need )
+	{
+		need += s.open - s.close;
+		return -1;
+	}
+
+	if( lo == hi )
+	{
+		return lo;
+	}
+
+	int mid = ( lo + hi ) / 2;
+	int found = forward( 2 * node, lo, mid, from, need );
+	return found >= 0 ? found : forward( 2 * node + 1, mid + 1, hi, from, need );
+}
+
+
+// Last line up to `to` where `need` more blocks are opened than closed.
+int LuaStructure::backward( int node, int lo, int hi, int to, int& need ) const
+{
+	if( lo > to )
+	{
+		return -1;
+	}
+
+	Summary const& s = m_tree.at( node );
+	if( hi <= to && s.open < need )
+	{
+		need += s.close - s.open;
+		return -1;
+	}
+
+	if( lo == hi )
+	{
+		return lo;
+	}
+
+	int mid = ( lo + hi ) / 2;
+	int found = backward( 2 * node + 1, mid + 1, hi, to, need );
+	return found >= 0 ? found : backward( 2 * node, lo, mid, to, need );
+}
+
+
+namespace
+{
+	// Index of the event that brings need to 0, reading events from `from`
+	// forwards (or backwards, where openers count as closers).
+	template <typename Event>
+	int walk( QVector<Event> const& list, int from, bool ahead, int& need )
+	{
+		for( int i = from; i >= 0 && i < list.size(); i += ahead ? 1 : -1 )
+		{
+			Event const& e = list.at( i );
+
+			// an else closes before it opens
+			if( ( ahead ? e.close : e.open ) && --need == 0 )
+			{
+				return i;
+			}
+			if( ahead ? e.open : e.close )
+			{
+				++need;
+			}
+		}
+		return -1;
+	}
+}
+
+
+bool LuaStructure::isFoldable( int block ) const
+{
+	return block >= 0 && block < m_lines.size() && m_lines.at( block ).summary.open > 0;
+}
+
+
+int LuaStructure::foldEnd( int block )
+{
+	if( ! isFoldable( block ) )
+	{
+		return -1;
+	}
+
+	refresh();
+
+	// the first block left open is closed after all the later ones are
+	int need = m_lines.at( block ).summary.open;
+	return forward( 1, 0, m_size - 1, block + 1, need );
+}
+
+
+bool LuaStructure::match( int position, Token* token, QVector<Token>* partners )
+{
+	partners->clear();
+
+	QTextBlock block = m_document->findBlock( position );
+	int n = block.blockNumber();
+	if( n < 0 || n >= m_lines.size() || m_lines.at( n ).entry == unknown_state )
+	{
+		return false;
+	}
+
+	QVector<Event> list;
+	events( block.text(), m_lines.at( n ).entry, &list );
+
+	// the token under the cursor, or else the one just before it
+	int column = position - block.position();
+	int at = -1;
+	for( int i = 0; i < list.size() && list.at( i ).start <= column; ++i )
+	{
+		if( column < list.at( i ).start + list.at( i ).length )
+		{
+			at = i;
+			break;
+		}
+		if( column == list.at( i ).start + list.at( i ).length )
+		{
+			at = i;
+		}
+	}
+
+	if( at < 0 )
+	{
+		return false;
+	}
+
+	token->position = block.position() + list.at( at ).start;
+	token->length = list.at( at ).length;
+
+	refresh();
+
+	for( int pass = 0; pass < 2; ++pass )
+	{
+		bool ahead = pass == 1;
+		if( ! ( ahead ? list.at( at ).open : list.at( at ).close ) )
+		{
+			continue;
+		}
+
+		int need = 1;
+		int i = walk( list, ahead ? at + 1 : at - 1, ahead, need );
+		QTextBlock other = block;
+		QVector<Event> const* found = &list;
+
+		if( i < 0 )
+		{
+			int m = ahead ? forward( 1, 0, m_size - 1, n + 1, need ) : ( n > 0 ? backward( 1, 0, m_size - 1, n - 1, need ) : -1 );
+			if( m < 0 || m_lines.at( m ).entry == unknown_state )
+			{
+				continue;
+			}
+
+			other = m_document->findBlockByNumber( m );
+			events( other.text(), m_lines.at( m ).entry, &m_events );
+			found = &m_events;
+			i = walk( m_events, ahead ? 0 : m_events.size() - 1, ahead, need );
+			if( i < 0 )
+			{
+				continue;
+			}
+		}
+
+		Token partner = { other.position() + found->at( i ).start, found->at( i ).length };
+		partners->append( partner );
+	}
+
+	return true;
+}
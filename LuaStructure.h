@@ -0,0 +1,113 @@
+#ifndef LUASTRUCTURE_H
+#define LUASTRUCTURE_H
+
+#include <QObject>
+#include <QVector>
+
+#include "LuaLexer.h"
+
+class QTextDocument;
+class QTimer;
+
+// Lua block structure of a document: where blocks are opened (function, do,
+// then, repeat and brackets) and where each is closed (end, until, and
+// elseif/else, which close one block and open the next).
+//
+// Each line is summarised as the closers it leaves unmatched followed by the
+// openers it leaves open. The summaries sit in a segment tree, so the line
+// closing an opener is found by descending the tree, O(log n), not by
+// reading the lines in between. An edit relexes only the lines it touched
+// (and those after it whose long string/comment state it changed); the tree
+// is brought up to date for the lines that changed when next queried.
+class LuaStructure : public QObject
+{
+	Q_OBJECT
+
+	public:
+
+		struct Token
+		{
+			int position;
+			int length;
+		};
+
+		explicit LuaStructure( QTextDocument* document );
+
+		// the line (block number) leaves something open
+		bool isFoldable( int block ) const;
+
+		// line closing the first block left open by this one, -1 if there is none
+		int foldEnd( int block );
+
+		// The keyword or bracket at position (or ending there) and the tokens
+		// it pairs with, false when there is none. else and elseif pair in both
+		// directions; partners is empty for an unmatched token.
+		bool match( int position, Token* token, QVector<Token>* partners );
+
+	signals:
+
+		// lines have become (or stopped being) foldable
+		void updated( void );
+
+	private slots:
+
+		void contentsChange( int position, int removed, int added );
+		void resume( void );
+
+	private:
+
+		// closers left unmatched, then openers left open
+		struct Summary
+		{
+			int close;
+			int open;
+		};
+
+		struct Line
+		{
+			int entry;		// lexer state the line was lexed with
+			int state;		// lexer state at its end
+			Summary summary;
+		};
+
+		struct Event
+		{
+			int start;
+			int length;
+			bool close;
+			bool open;
+		};
+
+		static Summary combine( Summary const& a, Summary const& b );
+		static Summary summarise( QVector<Event> const& events );
+		int events( QString const& text, int entry, QVector<Event>* out );
+
+		void lex( int budget );
+		void invalidate( int from, int to );
+		void refresh( void );
+
+		int forward( int node, int lo, int hi, int from, int& need ) const;
+		int backward( int node, int lo, int hi, int to, int& need ) const;
+
+		QTextDocument* m_document;
+		QTimer* m_timer;
+		int m_revision;
+
+		QVector<Line> m_lines;		// by block number
+
+		// lines not lexed since they changed
+		int m_dirtyFrom;
+		int m_dirtyTo;
+
+		// segment tree over the line summaries, leaves at m_size + n
+		QVector<Summary> m_tree;
+		int m_size;
+		int m_treeFrom;
+		int m_treeTo;
+
+		// reused between lines
+		QVector<LuaLexer::Token> m_tokens;
+		QVector<Event> m_events;
+};
+
+#endif // LUASTRUCTURE_H
@@ -4,147 +4,682 @@
 
 #include <QDebug>
 #include <QVariantMap>
-
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QTextCodec>
+#include <QTextDecoder>
+#include <QCryptographicHash>
+
+#include <atomic>
+#include <climits>
 #include <chrono>
+#include <ctime>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
-#include <cstdio>
-#include <csetjmp>
 
 #ifdef _WIN32
-#include <mingw.thread.h>
-#include <QWinEventNotifier>
 #include <windows.h>
-#include <io.h>
-#include <fcntl.h>
-#include <rpc.h>
-#define fdopen _fdopen
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#endif
+
+#include "RingBuffer.h"
+#include "LuaAllocator.h"
+#include "LuaBytecodeCache.h"
+
+
+namespace
+{
+	// cpu time used by the calling thread
+	double threadCpuSeconds( void )
+	{
+#ifdef _WIN32
+		FILETIME created, exited, kernel, user;
+		if( ! GetThreadTimes( GetCurrentThread(), &created, &exited, &kernel, &user ) )
+		{
+			return 0;
+		}
+
+		ULARGE_INTEGER k, u;
+		k.LowPart = kernel.dwLowDateTime;
+		k.HighPart = kernel.dwHighDateTime;
+		u.LowPart = user.dwLowDateTime;
+		u.HighPart = user.dwHighDateTime;
+		return ( k.QuadPart + u.QuadPart ) * 1e-7;
 #else
-#include <QSocketNotifier>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <sys/ioctl.h>
+		timespec ts;
+		if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) != 0 )
+		{
+			return 0;
+		}
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
 #endif
+	}
+
+	// line n is set in a breakpoint bitmap
+	inline bool hasLine( QVector<quint64> const& bits, int n )
+	{
+		return n >= 0 && ( n >> 6 ) < bits.size() && ( ( bits.at( n >> 6 ) >> ( n & 63 ) ) & 1 );
+	}
+}
 
 
 struct LuaThread::pi_State
 {
-#ifdef _WIN32
 	enum
 	{
-		buffer_size = 256
+		// default instructions between stop checks
+		hook_quantum = 1000
+	};
+
+	enum
+	{
+		// vm -> gui output ring, flushed early once this much is waiting
+		output_size = 1 << 20,
+		output_batch = 64 << 10
+	};
+
+	// how the vm carries on from a pause
+	enum Step
+	{
+		Run,			// to the next breakpoint
+		StepInto,
+		StepOver,
+		StepOut,
+		NoCommand
 	};
 
 	pi_State( LuaThread* parent ) :
 		controller( parent ),
-		thread( 0 )
+		thread( 0 ),
+		source( 0 ),
+		chunkname( "=script" ),
+		L( 0 ),
+		running( false ),
+		alive( false ),
+		pending( false ),
+		resetflag( false ),
+		quit( false ),
+		warm( false ),
+		runwarm( false ),
+		vm( 0 ),
+		caching( true ),
+		runcaching( true ),
+		cachehits( 0 ),
+		cachemisses( 0 ),
+		lastmemory( 0 ),
+		exitflag( false ),
+		reason( LuaThread::NotStopped ),
+		quantum( hook_quantum ),
+		runquantum( hook_quantum ),
+		instructions( 0 ),
+		hooks( 0 ),
+		cpustart( 0 ),
+		tracking( LuaThread::LineTracking ),
+		line( 0 ),
+		lastline( 0 ),
+		pausing( false ),
+		paused( false ),
+		command( NoCommand ),
+		pausedline( 0 ),
+		debuggen( 0 ),
+		seengen( -1 ),
+		stepping( Run ),
+		stepdepth( 0 ),
+		debugging( false ),
+		profiling( false ),
+		sampling( false ),
+		output( output_size ),
+		flushing( false ),
+		outbytes( 0 ),
+		decoder( QTextCodec::codecForName( "UTF-8" )->makeDecoder() )
+	{
+	}
+
+	~pi_State( void )
+	{
+		delete source;
+		delete decoder;
+	}
+
+	// lua_Reader over the script source
+	static char const* source_reader( lua_State* L, void* data, size_t* size )
+	{
+		(void) L;
+		pi_State* state = static_cast<pi_State*>( data );
+		state->piece = state->source->next();
+		*size = size_t( state->piece.size() );
+		return state->piece.constData();
+	}
+
+	LuaThread* controller;
+	std::thread* thread;
+	QByteArray script;
+	LuaThread::Source* source;		// instead of script when set
+	QByteArray piece;				// last piece read from source
+	QByteArray chunkname;
+
+	// search paths to add to lua vm (for loading packages)
+	QStringList searchdirs;
+
+	// guards controller, L and the request flags below
+	std::mutex mutex;
+	std::condition_variable wake;		// worker: new request
+	std::condition_variable finished;	// controller: run finished
+	lua_State* L;
+	bool running;
+
+	// worker requests
+	bool alive;
+	bool pending;
+	bool resetflag;
+	bool quit;
+
+	// warm vm: kept open between runs by the worker (worker thread only);
+	// warm is set under mutex, runwarm is its value for the current run
+	bool warm;
+	bool runwarm;		// vm thread
+	lua_State* vm;
+	QStringList vmdirs;
+
+	// compiled chunks, used when the vm was opened with caching
+	bool caching;
+	bool runcaching;	// vm thread
+	int cachehits;
+	int cachemisses;
+
+	// backs the vm, its arenas go when the vm is closed
+	LuaAllocator allocator;
+	quint64 lastmemory;		// gui thread
+
+	struct Module
+	{
+		QString path;	// empty for modules without a file (e.g. string)
+		QDateTime stamp;
+	};
+	QHash<QByteArray,Module> modules;
+	QHash<QByteArray,QSet<QString>> dependents;	// module -> requiring files
+
+	// cooperative stop, checked from the count hook
+	std::atomic<bool> exitflag;
+	std::atomic<int> reason;		// StopReason, the first one wins
+	int quantum;
+
+	// run budget: requested (under mutex) and the one in force (vm thread)
+	LuaThread::Budget budget;
+	LuaThread::Budget limits;
+	int runquantum;
+	quint64 instructions;
+	int hooks;
+	std::chrono::steady_clock::time_point deadline;
+	double cpustart;
+
+	// line tracking: written by the vm, sampled by the gui timer
+	LuaThread::TrackingMode tracking;
+	std::atomic<int> line;
+	int lastline;
+
+	// debugger requests and breakpoints (chunk -> line bitmap), under mutex;
+	// changes bump debuggen, which the hook compares with what it has seen
+	QHash<QByteArray, QVector<quint64>> breakpoints;
+	QVector<quint64> breaklines;		// lines set in any chunk
+	bool pausing;						// pause at the next line
+	bool paused;
+	int command;						// Step to leave the pause with
+	QString pausedchunk;
+	int pausedline;
+	std::condition_variable unpause;
+	std::atomic<int> debuggen;
+
+	// the vm's copies (vm thread)
+	int seengen;
+	QHash<QByteArray, QVector<quint64>> vmbreakpoints;
+	QVector<quint64> vmbreaklines;
+	int stepping;		// Step
+	int stepdepth;		// stack depth the step was taken at
+	bool debugging;		// stepping or breakpoints, the line hook is on
+
+	// sampling profiler, armed for a run when profiling was requested
+	bool profiling;
+	bool sampling;		// vm thread
+	LuaProfiler profiler;
+
+	// script output: vm thread writes, gui thread flushes
+	RingBuffer output;
+	std::atomic<bool> flushing;
+	std::atomic<quint64> outbytes;
+	QTextDecoder* decoder;
+
+	// run statistics, written by the vm before it signals stopped
+	std::chrono::steady_clock::time_point began;
+	LuaThread::Statistics stats;
+
+	static int lua_panic( lua_State* L )
+	{
+		qCritical( "PANIC: unprotected error in call to Lua API (%s)", lua_tostring( L, -1 ) );
+		return 0;
+	}
+
+	static pi_State* fromLua( lua_State* L )
+	{
+		return *static_cast<pi_State**>( lua_getextraspace( L ) );
+	}
+
+	static void lua_hook( lua_State* L, lua_Debug* arg )
 	{
-		pipe = "\\\\.\\pipe\\";
+		pi_State* state = fromLua( L );
+
+		// breakpoints changed or a pause was asked for
+		if( state->debuggen.load( std::memory_order_relaxed ) != state->seengen )
+		{
+			state->sync( L );
+		}
+
+		if( arg->event == LUA_HOOKLINE )
+		{
+			state->line.store( arg->currentline, std::memory_order_relaxed );
+			if( state->debugging )
+			{
+				state->debug( L, arg );
+			}
+		}
+		else
+		{
+			if( state->sampling )
+			{
+				state->profiler.sample( L );
+			}
+			state->charge();
+		}
 
-		// generate a random uuid for the pipe name
+		if( state->exitflag.load( std::memory_order_relaxed ) )
 		{
-			UUID id;
-			RPC_CSTR str;
-			UuidCreate( &id );
-			UuidToStringA( &id, &str );
-			pipe.append( (char*) str );
-			RpcStringFreeA( &str );
+			int reason = state->reason.load( std::memory_order_relaxed );
+			if( reason == LuaThread::StopRequested )
+			{
+				luaL_error( L, "script stopped" );
+			}
+			luaL_error( L, "script stopped: %s", LuaThread::describe( LuaThread::StopReason( reason ) ) );
 		}
+	}
 
-		prx = CreateNamedPipeA( pipe.data(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE, 2, 0, 256, 0, 0 );
-		ptx = CreateFileA( pipe.data(), GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0 );
+	// count hook: account for a quantum and stop once the budget is spent
+	void charge( void )
+	{
+		instructions += runquantum;
 
-		memset( &ovrx, 0, sizeof(ovrx) );
-		ovrx.hEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+		LuaThread::StopReason over = LuaThread::NotStopped;
+		if( limits.instructions && instructions >= limits.instructions )
+		{
+			over = LuaThread::InstructionsExceeded;
+		}
+		else if( limits.wallSeconds > 0 && std::chrono::steady_clock::now() >= deadline )
+		{
+			over = LuaThread::WallTimeExceeded;
+		}
+		else if( limits.cpuSeconds > 0 && ( ++hooks & 15 ) == 0 && threadCpuSeconds() - cpustart >= limits.cpuSeconds )
+		{
+			// the thread clock is a system call on some platforms, read it less often
+			over = LuaThread::CpuTimeExceeded;
+		}
 
-		restartrx();
+		if( over != LuaThread::NotStopped && ! exitflag.load( std::memory_order_relaxed ) )
+		{
+			halt( over );
+		}
 	}
 
-	~pi_State( void )
+	// vm thread: take up the gui's breakpoints and pause request
+	void sync( lua_State* L )
 	{
-		CancelIo( prx );
-		CloseHandle( prx );
-		CloseHandle( ptx );
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			seengen = debuggen.load( std::memory_order_relaxed );
+			vmbreakpoints = breakpoints;
+			vmbreaklines = breaklines;
+			if( pausing )
+			{
+				stepping = StepInto;
+			}
+		}
+		rehook( L );
 	}
 
-	void restartrx( void )
+	// vm thread: the line hook only while tracking or debugging needs it
+	void rehook( lua_State* L )
 	{
-		ReadFile( prx, buffer, buffer_size, 0, &ovrx );
+		debugging = stepping != Run || ! vmbreaklines.isEmpty();
+
+		// a stop in progress has its own hook
+		if( ! exitflag.load( std::memory_order_relaxed ) )
+		{
+			int mask = LUA_MASKCOUNT;
+			if( tracking == LuaThread::LineTracking || debugging )
+			{
+				mask |= LUA_MASKLINE;
+			}
+			lua_sethook( L, &lua_hook, mask, runquantum );
+		}
 	}
 
-	QString readrx( void )
+	static int depth( lua_State* L )
 	{
-		DWORD bytes;
-		GetOverlappedResult( prx, &ovrx, &bytes, FALSE );
+		lua_Debug ar;
+		int n = 0;
+		while( lua_getstack( L, n, &ar ) )
+		{
+			++n;
+		}
+		return n;
+	}
 
-		return QString::fromLocal8Bit( buffer, bytes );
+	// chunk name without its '=' or '@'
+	static char const* chunk( lua_Debug const* arg )
+	{
+		return arg->source[0] ? arg->source + 1 : arg->source;
 	}
 
-	QByteArray pipe;
+	// line hook while debugging: pause here for a step or a breakpoint
+	void debug( lua_State* L, lua_Debug* arg )
+	{
+		int n = arg->currentline;
 
-	HANDLE ptx, prx;
+		bool stop;
+		switch( stepping )
+		{
+			case StepInto:	stop = true; break;
+			case StepOver:	stop = depth( L ) <= stepdepth; break;
+			case StepOut:	stop = depth( L ) < stepdepth; break;
+			default:		stop = false; break;
+		}
 
-	OVERLAPPED ovrx;
-	char buffer[ buffer_size ];
+		// the line is tested against every chunk's lines at once, the
+		// chunk is only looked up when one of them has a breakpoint there
+		if( ! stop && hasLine( vmbreaklines, n ) )
+		{
+			lua_getinfo( L, "S", arg );
+			char const* name = chunk( arg );
+			auto it = vmbreakpoints.constFind( QByteArray::fromRawData( name, int( qstrlen( name ) ) ) );
+			stop = it != vmbreakpoints.constEnd() && hasLine( *it, n );
+		}
 
-#else
+		if( stop )
+		{
+			suspend( L, arg );
+		}
+	}
 
-	pi_State( LuaThread* parent ) :
-		controller( parent ),
-		thread( 0 )
+	// vm thread: wait for the gui to resume or step, or for a stop
+	void suspend( lua_State* L, lua_Debug* arg )
 	{
-		socketpair( AF_UNIX, SOCK_RAW, 0, sv );
+		lua_getinfo( L, "S", arg );
+		int level = depth( L );
+		std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			pausedchunk = QString::fromUtf8( chunk( arg ) );
+			pausedline = arg->currentline;
+			paused = true;
+			pausing = false;
+			command = NoCommand;
+			if( controller )
+			{
+				QMetaObject::invokeMethod( controller, "debug_paused", Qt::QueuedConnection );
+			}
+
+			unpause.wait( lock, [this]{ return command != NoCommand || exitflag.load(); } );
+
+			paused = false;
+			stepping = command == NoCommand ? Run : command;
+			stepdepth = level;
+			command = NoCommand;
+			if( controller )
+			{
+				QMetaObject::invokeMethod( controller, "resumed", Qt::QueuedConnection );
+			}
+		}
+
+		// time spent paused does not count against the wall time budget
+		deadline += std::chrono::steady_clock::now() - since;
+		rehook( L );
 	}
 
-	~pi_State( void )
+	// gui thread: carry on from a pause, or pause at the next line
+	void proceed( int step )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		if( paused )
+		{
+			command = step;
+			unpause.notify_all();
+		}
+		else if( step != Run )
+		{
+			pausing = true;
+			++debuggen;
+		}
+	}
+
+	// stop the run, recording why unless it is already stopping
+	void halt( LuaThread::StopReason why )
 	{
-		close( sv[0] );
-		close( sv[1] );
+		int expected = LuaThread::NotStopped;
+		reason.compare_exchange_strong( expected, why );
+		interrupt();
 	}
 
-	QString readrx( void )
+	// ask a running vm to raise the stop error at its next instruction
+	void interrupt( void )
 	{
-		int available;
-		ioctl( sv[0], FIONREAD, &available );
+		exitflag = true;
 
-		if( available > 0 )
+		std::lock_guard<std::mutex> lock( mutex );
+		if( L )
 		{
-			QByteArray buffer( available, '\0' );
-			recv( sv[0], buffer.data(), available, 0 );
+			// lua_sethook is safe to call asynchronously (see lua.c)
+			lua_sethook( L, &lua_hook, LUA_MASKCOUNT, 1 );
+		}
+
+		// a paused vm wakes up to stop
+		unpause.notify_all();
+	}
 
-			return QString::fromUtf8( buffer );
+	// queue a signal on the controller, unless it was abandoned by terminate()
+	void notify( char const* signal )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		if( controller )
+		{
+			QMetaObject::invokeMethod( controller, signal, Qt::QueuedConnection );
 		}
+	}
+
+	// vm thread: append to the output ring, blocking while the gui catches up
+	void write( char const* data, size_t n )
+	{
+		outbytes.fetch_add( n, std::memory_order_relaxed );
+
+		for( ;; )
+		{
+			size_t done = output.write( data, n );
+			data += done;
+			n -= done;
+
+			if( output.size() >= output_batch && ! flushing.exchange( true ) )
+			{
+				notify( "output_flush" );
+			}
+
+			if( n == 0 || exitflag.load( std::memory_order_relaxed ) )
+			{
+				break;
+			}
 
-		return QString();
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
 	}
 
-	int sv[2];
+	//
+	// print, io.write and io.stdout, redirected into the output ring
+	//
 
-#endif
+	static int lua_print( lua_State* L )
+	{
+		// number of arguments
+		int n = lua_gettop( L );
 
-	LuaThread* controller;
-	std::thread* thread;
-	QByteArray script;
+		// get tostring helper
+		lua_getglobal( L, "tostring" );
 
-	// search paths to add to lua vm (for loading packages)
-	QStringList searchdirs;
+		// assemble the whole line, then hand it over in one piece
+		luaL_Buffer b;
+		luaL_buffinit( L, &b );
+
+		for( int i = 1; i <= n; i++ )
+		{
+			lua_pushvalue( L, n + 1 );		// tostring function
+			lua_pushvalue( L, i );			// value
+			lua_call( L, 1, 1 );			// call tostring
 
-	// setjmp/longjmp for exiting vm
-	bool exitflag;
-	jmp_buf exitjmp;
+			if( ! lua_isstring( L, -1 ) )
+				return luaL_error( L, "'tostring' must return a string to 'print'" );
 
-	static void lua_hook( lua_State* L, lua_Debug* arg )
+			if( i > 1 ) luaL_addchar( &b, '\t' );
+			luaL_addvalue( &b );
+		}
+		luaL_addchar( &b, '\n' );
+		luaL_pushresult( &b );
+
+		size_t l;
+		char const* s = lua_tolstring( L, -1, &l );
+		fromLua( L )->write( s, l );
+		return 0;
+	}
+
+	static int console_write( lua_State* L, int first )
+	{
+		pi_State* state = fromLua( L );
+
+		for( int i = first; i <= lua_gettop( L ); i++ )
+		{
+			size_t l;
+			char const* s = luaL_checklstring( L, i, &l );
+			state->write( s, l );
+		}
+		return 0;
+	}
+
+	// console:write(...)
+	static int console_method_write( lua_State* L )
+	{
+		console_write( L, 2 );
+		lua_settop( L, 1 );
+		return 1;
+	}
+
+	static int console_noop( lua_State* L )
+	{
+		(void) L;
+		return 0;
+	}
+
+	static int console_tostring( lua_State* L )
+	{
+		lua_pushliteral( L, "file (console)" );
+		return 1;
+	}
+
+	// io.write(...): the console while io.output() is the default stdout
+	// upvalues: original io.write, original stdout file, console
+	static int io_write( lua_State* L )
 	{
-		lua_getfield( L, LUA_REGISTRYINDEX, "_control_state" );
-		pi_State* state = (pi_State*) lua_touserdata( L, -1 );
+		lua_getfield( L, LUA_REGISTRYINDEX, "_IO_output" );
+		bool console = lua_rawequal( L, -1, lua_upvalueindex( 2 ) );
 		lua_pop( L, 1 );
 
-		QMetaObject::invokeMethod( state->controller, "currentLine", Qt::QueuedConnection, Q_ARG(int,arg->currentline) );
+		if( console )
+		{
+			console_write( L, 1 );
+			lua_pushvalue( L, lua_upvalueindex( 3 ) );
+			return 1;
+		}
+
+		lua_pushvalue( L, lua_upvalueindex( 1 ) );
+		lua_insert( L, 1 );
+		lua_call( L, lua_gettop( L ) - 1, LUA_MULTRET );
+		return lua_gettop( L );
+	}
+
+	// io.output([file]): maps the console onto the original stdout file
+	// upvalues: original io.output, original stdout file, console
+	static int io_output( lua_State* L )
+	{
+		if( lua_rawequal( L, 1, lua_upvalueindex( 3 ) ) )
+		{
+			lua_pushvalue( L, lua_upvalueindex( 2 ) );
+			lua_setfield( L, LUA_REGISTRYINDEX, "_IO_output" );
+			lua_pushvalue( L, lua_upvalueindex( 3 ) );
+			return 1;
+		}
+
+		lua_pushvalue( L, lua_upvalueindex( 1 ) );
+		lua_insert( L, 1 );
+		lua_call( L, lua_gettop( L ) - 1, 1 );
 
-		if( state->exitflag )
+		if( lua_rawequal( L, -1, lua_upvalueindex( 2 ) ) )
 		{
-			longjmp( state->exitjmp, 1 );
+			lua_pushvalue( L, lua_upvalueindex( 3 ) );
 		}
+		return 1;
+	}
+
+	static void install_console( lua_State* L )
+	{
+		lua_pushcfunction( L, lua_print );
+		lua_setglobal( L, "print" );
+
+		// console object standing in for io.stdout
+		lua_newuserdata( L, 1 );							// console
+		luaL_Reg const methods[] =
+		{
+			{ "write", &console_method_write },
+			{ "flush", &console_noop },
+			{ "setvbuf", &console_noop },
+			{ "close", &console_noop },
+			{ 0, 0 }
+		};
+		lua_createtable( L, 0, 2 );							// console,mt
+		luaL_newlib( L, methods );							// console,mt,methods
+		lua_setfield( L, -2, "__index" );					// console,mt
+		lua_pushcfunction( L, &console_tostring );
+		lua_setfield( L, -2, "__tostring" );
+		lua_setmetatable( L, -2 );							// console
+
+		lua_getglobal( L, "io" );							// console,io
+
+		lua_getfield( L, -1, "write" );						// console,io,write
+		lua_getfield( L, -2, "stdout" );					// console,io,write,stdout
+		lua_pushvalue( L, -4 );								// console,io,write,stdout,console
+		lua_pushcclosure( L, &io_write, 3 );				// console,io,io_write
+		lua_setfield( L, -2, "write" );						// console,io
+
+		lua_getfield( L, -1, "output" );					// console,io,output
+		lua_getfield( L, -2, "stdout" );					// console,io,output,stdout
+		lua_pushvalue( L, -4 );								// console,io,output,stdout,console
+		lua_pushcclosure( L, &io_output, 3 );				// console,io,io_output
+		lua_setfield( L, -2, "output" );					// console,io
+
+		lua_pushvalue( L, -2 );								// console,io,console
+		lua_setfield( L, -2, "stdout" );					// console,io
+		lua_pop( L, 2 );									// empty!
 	}
 };
 
@@ -153,16 +688,27 @@ LuaThread::LuaThread( QObject* parent ) :
 	QObject( parent ),
 	m_state( new pi_State( this ) )
 {
-#ifdef _WIN32
-	QWinEventNotifier* pevt = new QWinEventNotifier( this );
-	pevt->setHandle( m_state->ovrx.hEvent );
-	connect( pevt, SIGNAL(activated(HANDLE)), this, SLOT(pipe_rx()) );
-	pevt->setEnabled( true );
-#else
-	QSocketNotifier* notifier = new QSocketNotifier( m_state->sv[0], QSocketNotifier::Read, this );
-	connect( notifier, SIGNAL(activated(int)), this, SLOT(pipe_rx()) );
-	notifier->setEnabled( true );
-#endif
+	m_flusher = new QTimer( this );
+	m_flusher->setInterval( 25 );
+	connect( m_flusher, &QTimer::timeout, this, &LuaThread::output_flush );
+	connect( this, &LuaThread::started, m_flusher, static_cast<void (QTimer::*)()>( &QTimer::start ) );
+	connect( this, &LuaThread::stopped, m_flusher, &QTimer::stop );
+	connect( this, &LuaThread::stopped, this, &LuaThread::output_flush );
+
+	// catches runs over their wall time that the hook cannot reach
+	m_watchdog = new QTimer( this );
+	m_watchdog->setSingleShot( true );
+	connect( m_watchdog, &QTimer::timeout, this, &LuaThread::watchdog_expired );
+	connect( this, &LuaThread::started, this, &LuaThread::watchdog_start );
+	connect( this, &LuaThread::stopped, m_watchdog, &QTimer::stop );
+	connect( this, &LuaThread::resumed, this, &LuaThread::watchdog_start );
+
+	m_sampler = new QTimer( this );
+	m_sampler->setInterval( 16 );
+	connect( m_sampler, &QTimer::timeout, this, &LuaThread::line_sample );
+	connect( this, &LuaThread::started, m_sampler, static_cast<void (QTimer::*)()>( &QTimer::start ) );
+	connect( this, &LuaThread::stopped, m_sampler, &QTimer::stop );
+	connect( this, &LuaThread::stopped, this, &LuaThread::line_sample );
 }
 
 
@@ -174,140 +720,488 @@ LuaThread::~LuaThread( void )
 		terminate();
 	}
 
+	shutdown();
+
 	delete m_state;
 }
 
 
-void LuaThread::pipe_rx( void )
+void LuaThread::output_flush( void )
 {
-	emit fromStdOut( m_state->readrx() );
+	m_state->flushing = false;
 
-#ifdef _WIN32
-	m_state->restartrx();
-#endif
+	QByteArray chunk( int( m_state->output.size() ), Qt::Uninitialized );
+	chunk.resize( int( m_state->output.read( chunk.data(), size_t( chunk.size() ) ) ) );
+
+	if( ! chunk.isEmpty() )
+	{
+		QString text = m_state->decoder->toUnicode( chunk );
+		if( ! text.isEmpty() )
+		{
+			emit fromStdOut( text );
+		}
+	}
 }
 
 
-void LuaThread::setScript( QString const& text )
+LuaThread::Statistics LuaThread::statistics( void ) const
 {
-	m_state->script = text.toUtf8();
+	return m_state->stats;
 }
 
 
-bool LuaThread::isRunning( void )
+void LuaThread::line_sample( void )
 {
-	if( m_state->thread == 0 )
+	int n = m_state->line.load( std::memory_order_relaxed );
+	if( n != m_state->lastline )
 	{
-		return false;
+		m_state->lastline = n;
+		emit currentLine( n );
 	}
 
-	if( m_state->thread->joinable() )
+	quint64 bytes = m_state->allocator.used();
+	if( bytes != m_state->lastmemory )
 	{
-		return false;
+		m_state->lastmemory = bytes;
+		emit memoryChanged( bytes );
 	}
+}
+
+
+void LuaThread::setScript( QString const& text )
+{
+	m_state->script = text.toUtf8();
 
-	return true;
+	delete m_state->source;
+	m_state->source = 0;
 }
 
 
-void LuaThread::start( void )
+void LuaThread::setScript( Source* source )
 {
-	if( isRunning() )
-	{
-		return;
-	}
+	m_state->script.clear();
 
-	stop();
+	delete m_state->source;
+	m_state->source = source;
+}
 
-	if( m_state->thread == 0 )
-	{
-		m_state->thread = new std::thread( std::bind( &LuaThread::thread, this ) );
-	}
+
+void LuaThread::setChunkName( QString const& name )
+{
+	m_state->chunkname = "=" + name.toUtf8();
 }
 
 
-void LuaThread::stop( void )
+bool LuaThread::isRunning( void )
 {
-	if( m_state->thread )
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	return m_state->running;
+}
+
+
+void LuaThread::start( void )
+{
+	std::unique_lock<std::mutex> lock( m_state->mutex );
+
+	if( m_state->running )
 	{
-		m_state->exitflag = true;
+		return;
+	}
 
-		if( m_state->thread->joinable() )
+	if( ! m_state->alive )
+	{
+		// reap the previous (cold) worker, it has finished
+		if( m_state->thread )
 		{
+			lock.unlock();
 			m_state->thread->join();
+			lock.lock();
 			delete m_state->thread;
-			m_state->thread = 0;
 		}
+
+		m_state->alive = true;
+		m_state->thread = new std::thread( &LuaThread::thread, m_state );
 	}
+
+	m_state->exitflag = false;
+	m_state->reason = NotStopped;
+	m_state->running = true;
+	m_state->pending = true;
+	m_state->wake.notify_all();
 }
 
 
-bool LuaThread::wait( unsigned s )
+void LuaThread::stop( void )
 {
-	return true;
+	if( isRunning() )
+	{
+		m_state->halt( StopRequested );
+	}
 }
 
 
-void LuaThread::terminate( void )
+bool LuaThread::wait( unsigned ms )
 {
+	std::unique_lock<std::mutex> lock( m_state->mutex );
+	return m_state->finished.wait_for( lock, std::chrono::milliseconds( ms ), [this]{ return ! m_state->running; } );
 }
 
 
-void LuaThread::setSearchDirs( QString const& dir )
+void LuaThread::terminate( void )
 {
-	m_state->searchdirs.clear();
-	m_state->searchdirs << dir;
-}
+	stop();
+	if( wait( 1000 ) )
+	{
+		return;
+	}
 
-void LuaThread::setSearchDirs( QStringList const& dirs )
-{
-	m_state->searchdirs = dirs;
+	pi_State* old = m_state;
+
+	{
+		std::lock_guard<std::mutex> lock( old->mutex );
+		if( ! old->running )
+		{
+			return;
+		}
+
+		// The vm is stuck outside of Lua code (e.g. in a blocking C call)
+		// where the stop hook cannot reach it. Abandon the thread; it frees
+		// the old state when it eventually returns.
+		old->controller = 0;
+		old->thread->detach();
+		delete old->thread;
+		old->thread = 0;
+	}
+
+	m_state = new pi_State( this );
+	m_state->searchdirs = old->searchdirs;
+	m_state->chunkname = old->chunkname;
+	m_state->quantum = old->quantum;
+	m_state->tracking = old->tracking;
+	m_state->warm = old->warm;
+	m_state->stats.status = StoppedExit;
+	m_state->stats.stopReason = StopReason( old->reason.load() );
+	m_state->budget = old->budget;
+	m_state->profiling = old->profiling;
+	m_state->profiler.setRate( old->profiler.rate() );
+	m_state->allocator.setLimit( old->allocator.limit() );
+	m_state->caching = old->caching;
+	m_state->breakpoints = old->breakpoints;
+	m_state->breaklines = old->breaklines;
+
+	emit stopped();
 }
 
 
-namespace
+void LuaThread::shutdown( void )
 {
-	int luaprint (lua_State *L)
 	{
-		// number of arguments
-		int n = lua_gettop( L );
+		std::lock_guard<std::mutex> lock( m_state->mutex );
+		m_state->quit = true;
+		m_state->wake.notify_all();
+	}
 
-		// get output file stream
-		lua_getfield( L, LUA_REGISTRYINDEX, "_IO_output" );
-		luaL_Stream* stream = (luaL_Stream*) lua_touserdata( L, -1 );
-		lua_pop( L, 1 );
+	if( m_state->thread )
+	{
+		m_state->thread->join();
+		delete m_state->thread;
+		m_state->thread = 0;
+	}
 
-		// get tostring helper
-		lua_getglobal( L, "tostring" );
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	m_state->quit = false;
+}
 
-		for( int i = 1; i <= n; i++ )
-		{
-			const char *s;
-			size_t l;
 
-			lua_pushvalue( L, -1 );			// tostring function
-			lua_pushvalue( L, i );			// value
-			lua_call(L, 1, 1);				// call tostring
-			s = lua_tolstring(L, -1, &l);	// get result
+bool LuaThread::isWarm( void ) const
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	return m_state->warm;
+}
+
+
+void LuaThread::setWarm( bool warm )
+{
+	bool idle;
+	{
+		std::lock_guard<std::mutex> lock( m_state->mutex );
+		m_state->warm = warm;
+		idle = ! m_state->running;
+	}
+
+	// a cold worker finishes with its current run
+	if( ! warm && idle )
+	{
+		shutdown();
+	}
+}
+
+
+void LuaThread::reset( void )
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	if( m_state->alive )
+	{
+		m_state->resetflag = true;
+		m_state->wake.notify_all();
+	}
+}
+
+
+LuaThread::TrackingMode LuaThread::trackingMode( void ) const
+{
+	return m_state->tracking;
+}
+
+
+void LuaThread::setTrackingMode( TrackingMode mode )
+{
+	m_state->tracking = mode;
+}
+
+
+quint64 LuaThread::memoryUsage( void ) const
+{
+	return m_state->allocator.used();
+}
+
+
+quint64 LuaThread::memoryLimit( void ) const
+{
+	return m_state->allocator.limit();
+}
+
+
+void LuaThread::setBytecodeCache( bool enable )
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	m_state->caching = enable;
+}
 
-			if( s == NULL )
-				return luaL_error(L, "'tostring' must return a string to 'print'");
 
-			if( i > 1 ) fputc( '\t', stream->f );
-			fwrite( s, l, 1, stream->f );
+void LuaThread::setMemoryLimit( quint64 bytes )
+{
+	m_state->allocator.setLimit( size_t( bytes ) );
+}
+
+
+bool LuaThread::isProfiling( void ) const
+{
+	return m_state->profiling;
+}
+
+
+void LuaThread::setProfiling( bool enable )
+{
+	m_state->profiling = enable;
+}
+
+
+void LuaThread::setProfilingRate( int hz )
+{
+	m_state->profiler.setRate( hz );
+}
+
+
+LuaProfiler::Report LuaThread::profile( void ) const
+{
+	return m_state->profiler.report();
+}
+
+
+LuaThread::Budget LuaThread::budget( void ) const
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	return m_state->budget;
+}
+
+
+void LuaThread::setBudget( Budget const& budget )
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	m_state->budget = budget;
+}
+
+
+char const* LuaThread::describe( StopReason reason )
+{
+	switch( reason )
+	{
+		case NotStopped:			return "not stopped";
+		case StopRequested:			return "stop requested";
+		case WallTimeExceeded:		return "wall time limit exceeded";
+		case CpuTimeExceeded:		return "cpu time limit exceeded";
+		case InstructionsExceeded:	return "instruction limit exceeded";
+	}
+	return "?";
+}
+
+
+void LuaThread::watchdog_start( void )
+{
+	double seconds = budget().wallSeconds;
+	if( seconds > 0 )
+	{
+		// the hook normally gets there first, allow it a second's grace
+		m_watchdog->start( int( qMin( seconds * 1000 + 1000, double( INT_MAX ) ) ) );
+	}
+}
+
+
+void LuaThread::debug_paused( void )
+{
+	QString chunk;
+	int line;
+	{
+		std::lock_guard<std::mutex> lock( m_state->mutex );
+		chunk = m_state->pausedchunk;
+		line = m_state->pausedline;
+	}
+
+	// restarted on resumed(), the hook keeps the wall time budget meanwhile
+	m_watchdog->stop();
+
+	emit paused( chunk, line );
+}
+
 
-			lua_pop(L, 1);					// pop result
+QString LuaThread::chunkName( void ) const
+{
+	return QString::fromUtf8( m_state->chunkname.mid( 1 ) );
+}
+
+
+bool LuaThread::isPaused( void ) const
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	return m_state->paused;
+}
+
+
+void LuaThread::setBreakpoints( QString const& chunk, QList<int> const& lines )
+{
+	QVector<quint64> bits;
+	for( int n : lines )
+	{
+		if( n > 0 )
+		{
+			if( ( n >> 6 ) >= bits.size() )
+			{
+				bits.resize( ( n >> 6 ) + 1 );
+			}
+			bits[ n >> 6 ] |= quint64( 1 ) << ( n & 63 );
 		}
-		fputc( '\n', stream->f );
-		return 0;
 	}
 
-	int closefn( lua_State* L )
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+
+	QByteArray key = chunk.toUtf8();
+	if( bits.isEmpty() )
 	{
-		(void) L;
-		return 0;
+		m_state->breakpoints.remove( key );
+	}
+	else
+	{
+		m_state->breakpoints.insert( key, bits );
+	}
+
+	m_state->breaklines.clear();
+	for( auto const& b : m_state->breakpoints )
+	{
+		if( b.size() > m_state->breaklines.size() )
+		{
+			m_state->breaklines.resize( b.size() );
+		}
+		for( int i = 0; i < b.size(); ++i )
+		{
+			m_state->breaklines[i] |= b.at( i );
+		}
+	}
+
+	++m_state->debuggen;
+}
+
+
+void LuaThread::clearBreakpoints( void )
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	m_state->breakpoints.clear();
+	m_state->breaklines.clear();
+	++m_state->debuggen;
+}
+
+
+void LuaThread::pause( void )
+{
+	std::lock_guard<std::mutex> lock( m_state->mutex );
+	if( ! m_state->paused )
+	{
+		m_state->pausing = true;
+		++m_state->debuggen;
+	}
+}
+
+
+void LuaThread::resume( void )
+{
+	m_state->proceed( pi_State::Run );
+}
+
+
+void LuaThread::stepInto( void )
+{
+	m_state->proceed( pi_State::StepInto );
+}
+
+
+void LuaThread::stepOver( void )
+{
+	m_state->proceed( pi_State::StepOver );
+}
+
+
+void LuaThread::stepOut( void )
+{
+	m_state->proceed( pi_State::StepOut );
+}
+
+
+void LuaThread::watchdog_expired( void )
+{
+	if( isRunning() )
+	{
+		m_state->halt( WallTimeExceeded );
+		terminate();
 	}
+}
+
+
+void LuaThread::setHookQuantum( int instructions )
+{
+	m_state->quantum = qMax( 1, instructions );
+}
+
 
+void LuaThread::setTrackingInterval( int ms )
+{
+	m_sampler->setInterval( ms );
+}
+
+
+void LuaThread::setSearchDirs( QString const& dir )
+{
+	m_state->searchdirs.clear();
+	m_state->searchdirs << dir;
+}
+
+void LuaThread::setSearchDirs( QStringList const& dirs )
+{
+	m_state->searchdirs = dirs;
+}
+
+
+namespace
+{
 	int luatraceback( lua_State* L )
 	{
 		char const* msg = 0;
@@ -322,45 +1216,84 @@ namespace
 	}
 }
 
-void LuaThread::thread( void )
+// require() wrapper used by the warm vm, records which file required which
+// module so that a change on disk also invalidates the modules depending on it
+int LuaThread::lua_require( lua_State* L )
 {
-	QMetaObject::invokeMethod( this, "started", Qt::QueuedConnection );
+	pi_State* state = pi_State::fromLua( L );
+	QByteArray name( luaL_checkstring( L, 1 ) );
 
-	lua_State* L = luaL_newstate();
-	luaL_openlibs( L );
+	lua_Debug ar;
+	if( lua_getstack( L, 1, &ar ) && lua_getinfo( L, "S", &ar ) && ar.source[0] == '@' )
+	{
+		state->dependents[ name ].insert( QString::fromUtf8( ar.source + 1 ) );
+	}
 
-	//
-	// override lua print function (to use io.stdout)
-	//
+	lua_pushvalue( L, lua_upvalueindex( 1 ) );
+	lua_insert( L, 1 );
+	lua_call( L, lua_gettop( L ) - 1, LUA_MULTRET );
 
-	lua_pushcfunction( L, luaprint );
-	lua_setglobal( L, "print" );
+	return lua_gettop( L );
+}
 
-	//
-	// Set io.stdout file handle
-	//
 
-#ifdef _WIN32
-	int fd = _open_osfhandle( (intptr_t) m_state->ptx, _O_BINARY | _O_WRONLY );
-#else
-	int fd = m_state->sv[1];
-#endif
+// package.searchers entry ahead of the standard Lua file searcher: finds the
+// module the same way but loads it through the bytecode cache
+int LuaThread::lua_searcher( lua_State* L )
+{
+	pi_State* state = pi_State::fromLua( L );
+	char const* name = luaL_checkstring( L, 1 );
+
+	lua_getglobal( L, "package" );
+	lua_getfield( L, -1, "searchpath" );
+	lua_pushstring( L, name );
+	lua_getfield( L, -3, "path" );
+	lua_call( L, 2, 2 );						// filename or nil,message
+	if( lua_isnil( L, -2 ) )
+	{
+		return 1;								// message
+	}
+	lua_pop( L, 1 );
+
+	QByteArray filename( lua_tostring( L, -1 ) );
+	QFile file( QString::fromUtf8( filename ) );
+	if( ! file.open( QFile::ReadOnly ) )
+	{
+		// leave it to the standard searcher to report
+		lua_pushfstring( L, "\n\tcannot read '%s'", filename.constData() );
+		return 1;
+	}
+
+	bool hit;
+	QByteArray chunkname = "@" + filename;
+	if( LuaBytecodeCache::instance()->load( L, file.readAll(), chunkname.constData(), &hit ) != LUA_OK )
+	{
+		return luaL_error( L, "error loading module '%s' from file '%s':\n\t%s",
+			name, filename.constData(), lua_tostring( L, -1 ) );
+	}
+
+	++( hit ? state->cachehits : state->cachemisses );
+
+	lua_pushstring( L, filename.constData() );
+	return 2;
+}
+
+
+lua_State* LuaThread::openVm( pi_State* state )
+{
+	// the standard setup does not count against the script's memory limit
+	size_t limit = state->allocator.limit();
+	state->allocator.setLimit( 0 );
 
-	luaL_Stream* stream = (luaL_Stream*) lua_newuserdata( L, sizeof(luaL_Stream) );
-	stream->f = fdopen( fd, "w" );
-	setvbuf( stream->f, NULL, _IONBF, 0 );
-	stream->closef = &closefn;
+	lua_State* L = lua_newstate( &LuaAllocator::alloc, &state->allocator );
+	lua_atpanic( L, &pi_State::lua_panic );
+	luaL_openlibs( L );
 
-	luaL_getmetatable( L, LUA_FILEHANDLE );
-	lua_setmetatable( L, -2 );
+	//
+	// route print, io.write and io.stdout into the output ring
+	//
 
-	lua_getglobal( L, "io" );							// io,<file>
-	lua_pushvalue( L, -2 );								// <file>,io,<file>
-	lua_setfield( L, -2, "stdout" );					// io,<file>
-	lua_pop( L, 1 );									// <file>
-	lua_pushvalue( L, -1 );								// <file>,<file>
-	lua_setfield( L, LUA_REGISTRYINDEX, "_IO_output" );	// <file>
-	lua_pop( L, 1 );									// empty!
+	pi_State::install_console( L );
 
 	//
 	// append script search dirs to package.path
@@ -368,7 +1301,7 @@ void LuaThread::thread( void )
 
 	lua_getglobal( L, "package" );
 	lua_pushstring( L, "" );
-	for( auto const& dir : m_state->searchdirs )
+	for( auto const& dir : state->searchdirs )
 	{
 		lua_pushstring( L, dir.toUtf8().data() );
 		lua_pushstring( L, "/?.lua" );
@@ -384,37 +1317,422 @@ void LuaThread::thread( void )
 	lua_setfield( L, -2, "path" );
 	lua_pop( L, 1 );
 
-	// push state pointer into registry
-	lua_pushlightuserdata( L, m_state );
-	lua_setfield( L, LUA_REGISTRYINDEX, "_control_state" );
+	// state pointer lives in the extra space, hooks fetch it without a lookup
+	*static_cast<pi_State**>( lua_getextraspace( L ) ) = state;
+
+	//
+	// warm vm: track module dependencies through require
+	//
+
+	if( state->runcaching )
+	{
+		lua_getglobal( L, "package" );
+		lua_getfield( L, -1, "searchers" );
+		lua_getglobal( L, "table" );
+		lua_getfield( L, -1, "insert" );
+		lua_pushvalue( L, -3 );
+		lua_pushinteger( L, 2 );
+		lua_pushcfunction( L, &LuaThread::lua_searcher );
+		lua_call( L, 3, 0 );
+		lua_pop( L, 3 );
+	}
+
+	if( state->runwarm )
+	{
+		lua_getglobal( L, "require" );
+		lua_pushcclosure( L, &LuaThread::lua_require, 1 );
+		lua_setglobal( L, "require" );
+	}
+
+	state->vmdirs = state->searchdirs;
+	state->allocator.setLimit( limit );
+
+	return L;
+}
 
-	// set flags, hooks...
-	m_state->exitflag = false;
-	lua_sethook( L, &pi_State::lua_hook, LUA_MASKLINE, 0 );
 
-	// exit point for stop event
-	if( setjmp( m_state->exitjmp ) == 0 )
+void LuaThread::closeVm( pi_State* state )
+{
+	if( state->vm )
 	{
-		// backtrace maker
-		lua_pushcclosure( L, luatraceback, 0 );
+		lua_close( state->vm );
+		state->vm = 0;
+		state->allocator.release();
+	}
+
+	state->modules.clear();
+	state->dependents.clear();
+}
+
+
+// drop package.loaded entries whose files changed on disk since they were
+// loaded, along with every module that required them
+void LuaThread::sweep( pi_State* state, lua_State* L )
+{
+	QList<QByteArray> queue;
 
-		int err = luaL_loadbuffer( L, m_state->script.data(), m_state->script.length(), "=script" );
-		if( err == LUA_OK )
+	for( auto it = state->modules.constBegin(); it != state->modules.constEnd(); ++it )
+	{
+		if( it->path.isEmpty() )
 		{
-			err = lua_pcall( L, 0, LUA_MULTRET, -2 );
+			continue;
 		}
 
-		if( err == LUA_ERRRUN || err == LUA_ERRSYNTAX )
+		QFileInfo info( it->path );
+		if( ! info.exists() || info.lastModified() != it->stamp )
+		{
+			queue.append( it.key() );
+		}
+	}
+
+	if( queue.isEmpty() )
+	{
+		return;
+	}
+
+	QHash<QString,QByteArray> names;
+	for( auto it = state->modules.constBegin(); it != state->modules.constEnd(); ++it )
+	{
+		if( ! it->path.isEmpty() )
+		{
+			names.insert( it->path, it.key() );
+		}
+	}
+
+	QSet<QByteArray> stale;
+	while( ! queue.isEmpty() )
+	{
+		QByteArray name = queue.takeFirst();
+		if( stale.contains( name ) )
+		{
+			continue;
+		}
+
+		stale.insert( name );
+		for( auto const& file : state->dependents.value( name ) )
+		{
+			if( names.contains( file ) )
+			{
+				queue.append( names.value( file ) );
+			}
+		}
+	}
+
+	lua_getglobal( L, "package" );
+	lua_getfield( L, -1, "loaded" );
+	for( auto const& name : stale )
+	{
+		lua_pushnil( L );
+		lua_setfield( L, -2, name.constData() );
+
+		state->modules.remove( name );
+		state->dependents.remove( name );
+	}
+	lua_pop( L, 2 );
+}
+
+
+// note the file and timestamp of modules loaded during the last run
+void LuaThread::record( pi_State* state, lua_State* L )
+{
+	lua_getglobal( L, "package" );					// package
+	lua_getfield( L, -1, "searchpath" );			// package,searchpath
+	lua_getfield( L, -2, "path" );					// package,searchpath,path
+	lua_getfield( L, -3, "loaded" );				// package,searchpath,path,loaded
+
+	lua_pushnil( L );
+	while( lua_next( L, -2 ) )						// ...,loaded,key,value
+	{
+		lua_pop( L, 1 );
+
+		if( lua_type( L, -1 ) != LUA_TSTRING )
+		{
+			continue;
+		}
+
+		QByteArray name( lua_tostring( L, -1 ) );
+		if( state->modules.contains( name ) )
+		{
+			continue;
+		}
+
+		pi_State::Module module;
+
+		lua_pushvalue( L, -4 );						// searchpath
+		lua_pushvalue( L, -2 );						// name
+		lua_pushvalue( L, -5 );						// path
+		if( lua_pcall( L, 2, 1, 0 ) == LUA_OK && lua_isstring( L, -1 ) )
+		{
+			module.path = QString::fromUtf8( lua_tostring( L, -1 ) );
+			module.stamp = QFileInfo( module.path ).lastModified();
+		}
+		lua_pop( L, 1 );
+
+		state->modules.insert( name, module );
+	}
+
+	lua_pop( L, 4 );
+}
+
+
+void LuaThread::execute( pi_State* state )
+{
+	state->notify( "started" );
+
+	state->outbytes = 0;
+	state->began = std::chrono::steady_clock::now();
+	double cpu = threadCpuSeconds();
+
+	// settings the gui thread may change while this runs
+	{
+		std::lock_guard<std::mutex> lock( state->mutex );
+		state->runwarm = state->warm;
+		state->runcaching = state->caching;
+	}
+
+	if( state->vm && state->vmdirs != state->searchdirs )
+	{
+		closeVm( state );
+	}
+
+	if( state->vm == 0 )
+	{
+		state->vm = openVm( state );
+	}
+	else
+	{
+		sweep( state, state->vm );
+	}
+
+	state->allocator.resetPeak();
+
+	lua_State* L = state->vm;
+
+	{
+		std::lock_guard<std::mutex> lock( state->mutex );
+		state->limits = state->budget;
+	}
+	state->runquantum = state->quantum;
+	state->instructions = 0;
+	state->hooks = 0;
+	state->deadline = state->began + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>( state->limits.wallSeconds ) );
+	state->cpustart = cpu;
+
+	// set hooks; the count hook checks for stop requests and the budget every
+	// quantum, the line hook is on for line tracking and while debugging
+	state->line.store( 0, std::memory_order_relaxed );
+	state->stepping = pi_State::Run;
+	state->sync( L );
+
+	state->sampling = state->profiling;
+	if( state->sampling )
+	{
+		state->profiler.begin( state->chunkname.mid( 1 ) );
+	}
+
+	// publish the vm so stop() can shorten the hook interval
+	{
+		std::lock_guard<std::mutex> lock( state->mutex );
+		state->L = L;
+	}
+
+	if( state->exitflag )
+	{
+		state->interrupt();
+	}
+
+	// backtrace maker
+	lua_pushcclosure( L, luatraceback, 0 );
+
+	state->cachehits = 0;
+	state->cachemisses = 0;
+
+	int err;
+	bool caching = state->runcaching;
+
+	char const* chunkname = state->chunkname.constData();
+
+	if( state->source )
+	{
+		// streamed straight into the parser, never held in one piece
+		if( caching )
+		{
+			QCryptographicHash hash( QCryptographicHash::Sha1 );
+			LuaBytecodeCache::beginKey( hash, chunkname );
+			for( QByteArray piece = state->source->next(); ! piece.isEmpty(); piece = state->source->next() )
+			{
+				hash.addData( piece );
+			}
+			state->source->rewind();
+
+			bool hit;
+			err = LuaBytecodeCache::instance()->load( L, hash.result(), &pi_State::source_reader, state, chunkname, &hit );
+			++( hit ? state->cachehits : state->cachemisses );
+		}
+		else
+		{
+			err = lua_load( L, &pi_State::source_reader, state, chunkname, 0 );
+		}
+
+		delete state->source;
+		state->source = 0;
+		state->piece.clear();
+	}
+	else if( caching )
+	{
+		bool hit;
+		err = LuaBytecodeCache::instance()->load( L, state->script, chunkname, &hit );
+		++( hit ? state->cachehits : state->cachemisses );
+	}
+	else
+	{
+		err = luaL_loadbuffer( L, state->script.data(), state->script.length(), chunkname );
+	}
+
+	if( err == LUA_OK )
+	{
+		err = lua_pcall( L, 0, 0, -2 );
+	}
+
+	if( err != LUA_OK )
+	{
+		// built outside Lua, which may have no memory left to do it
+		QByteArray msg;
+		if( err == LUA_ERRMEM )
+		{
+			msg = "not enough memory";
+			size_t limit = state->allocator.limit();
+			if( limit > 0 )
+			{
+				msg += " (limit " + QByteArray::number( double( limit ) / ( 1 << 20 ), 'g', 4 ) + " MB)";
+			}
+		}
+		else
 		{
-			char const* str;
 			size_t n;
-			str = lua_tolstring( L, -1, &n );
-			fwrite( str, n, 1, stream->f );
-			fputc( '\n', stream->f );
+			char const* str = lua_tolstring( L, -1, &n );
+			msg = str ? QByteArray( str, int( n ) ) : QByteArray( "(error object is not a string)" );
+		}
+
+		msg += '\n';
+		state->write( msg.constData(), size_t( msg.size() ) );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( state->mutex );
+		state->L = 0;
+	}
+
+	lua_sethook( L, 0, 0, 0 );
+	lua_settop( L, 0 );
+
+	// a pause asked for too late to happen is not carried into the next run
+	{
+		std::lock_guard<std::mutex> lock( state->mutex );
+		state->pausing = false;
+	}
+
+	if( state->sampling )
+	{
+		state->profiler.end();
+		state->sampling = false;
+	}
+
+	if( state->runwarm )
+	{
+		record( state, L );
+	}
+	else
+	{
+		closeVm( state );
+	}
+
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - state->began;
+	state->stats.wallSeconds = wall.count();
+	state->stats.cpuSeconds = threadCpuSeconds() - cpu;
+	state->stats.outputBytes = state->outbytes;
+	state->stats.peakBytes = state->allocator.peak();
+	state->stats.cacheHits = state->cachehits;
+	state->stats.cacheMisses = state->cachemisses;
+	state->stats.instructions = state->instructions;
+	state->stats.stopReason = StopReason( state->reason.load() );
+
+	if( err == LUA_OK )
+	{
+		state->stats.status = NormalExit;
+	}
+	else
+	{
+		state->stats.status = state->exitflag ? StoppedExit : ErrorExit;
+	}
+}
+
+
+void LuaThread::thread( pi_State* state )
+{
+	std::unique_lock<std::mutex> lock( state->mutex );
+
+	for( ;; )
+	{
+		state->wake.wait( lock, [state]{
+			return state->pending || state->resetflag || state->quit || state->controller == 0;
+		} );
+
+		if( state->resetflag || state->quit || state->controller == 0 )
+		{
+			state->resetflag = false;
+			lock.unlock();
+			closeVm( state );
+			lock.lock();
+		}
+
+		if( state->quit || state->controller == 0 )
+		{
+			break;
+		}
+
+		if( ! state->pending )
+		{
+			continue;
+		}
+
+		state->pending = false;
+		lock.unlock();
+
+		execute( state );
+
+		lock.lock();
+		state->running = false;
+		state->finished.notify_all();
+
+		// only once running is cleared, so the controller may start() again
+		if( state->controller )
+		{
+			QMetaObject::invokeMethod( state->controller, "stopped", Qt::QueuedConnection );
+		}
+
+		if( ! state->warm )
+		{
+			lock.unlock();
+			closeVm( state );
+			lock.lock();
+
+			// started again while closing
+			if( ! state->pending )
+			{
+				break;
+			}
 		}
 	}
 
-	lua_close( L );
+	state->alive = false;
+	bool abandoned = ( state->controller == 0 );
+	lock.unlock();
 
-	QMetaObject::invokeMethod( this, "stopped", Qt::QueuedConnection );
+	if( abandoned )
+	{
+		closeVm( state );
+		delete state;
+	}
 }
@@ -4,6 +4,10 @@
 
 #include <QObject>
 
+#include "LuaProfiler.h"
+
+class QTimer;
+struct lua_State;
 
 class LuaThread : public QObject
 {
@@ -14,17 +18,135 @@ class LuaThread : public QObject
 
 	public:
 
+		enum TrackingMode
+		{
+			NoTracking,		// count hook only, for stop requests
+			LineTracking	// line hook, sampled into currentLine()
+		};
+
+		enum ExitStatus
+		{
+			NormalExit,		// script returned
+			ErrorExit,		// syntax or runtime error
+			StoppedExit		// stop(), terminate() or a budget ran out
+		};
+
+		enum StopReason
+		{
+			NotStopped,
+			StopRequested,			// stop() or terminate()
+			WallTimeExceeded,
+			CpuTimeExceeded,
+			InstructionsExceeded
+		};
+
+		// Limits for each run, 0 for none. They are checked from the count
+		// hook, so the instruction count is only as fine as the hook quantum.
+		// A run stuck in a C call past its wall time is terminate()d.
+		struct Budget
+		{
+			Budget( void ) :
+				wallSeconds( 0 ),
+				cpuSeconds( 0 ),
+				instructions( 0 )
+			{
+			}
+
+			double wallSeconds;
+			double cpuSeconds;
+			quint64 instructions;
+		};
+
+		struct Statistics
+		{
+			Statistics( void ) :
+				status( NormalExit ),
+				stopReason( NotStopped ),
+				wallSeconds( 0 ),
+				cpuSeconds( 0 ),
+				outputBytes( 0 ),
+				peakBytes( 0 ),
+				cacheHits( 0 ),
+				cacheMisses( 0 ),
+				instructions( 0 )
+			{
+			}
+
+			ExitStatus status;
+			StopReason stopReason;	// why a StoppedExit stopped
+			double wallSeconds;
+			double cpuSeconds;		// vm thread only
+			quint64 outputBytes;
+			quint64 peakBytes;		// most memory held by the vm
+
+			// chunks loaded from the bytecode cache, or compiled
+			int cacheHits;
+			int cacheMisses;
+
+			// vm instructions, counted in hook quanta
+			quint64 instructions;
+		};
+
+		// Script text handed to the vm in pieces instead of one buffer. It is
+		// read and destroyed on the vm thread once the script is parsed, so
+		// it must not refer to anything the gui thread may change.
+		class Source
+		{
+			public:
+				virtual ~Source( void ) {}
+
+				// next piece of UTF-8 text, empty at the end
+				virtual QByteArray next( void ) = 0;
+
+				// start over (the bytecode cache hashes the text first)
+				virtual void rewind( void ) = 0;
+		};
+
 		LuaThread( QObject* parent = 0 );
 		~LuaThread( void );
 
-		bool wait( unsigned s = 10000 );
+		bool wait( unsigned ms = 10000 );
 		void terminate( void );
 
 		bool isRunning( void );
+		bool isWarm( void ) const;
+
+		TrackingMode trackingMode( void ) const;
+
+		Budget budget( void ) const;
+
+		static char const* describe( StopReason reason );
+
+		// figures for the last completed run
+		Statistics statistics( void ) const;
+
+		bool isProfiling( void ) const;
+
+		// bytes held by the vm right now, and the cap (0: none)
+		quint64 memoryUsage( void ) const;
+		quint64 memoryLimit( void ) const;
+
+		// samples taken during the last completed run, when profiling
+		LuaProfiler::Report profile( void ) const;
+
+		// as set by setChunkName(), the chunk to give breakpoints for the script
+		QString chunkName( void ) const;
+
+		// stopped at a breakpoint or step, waiting for resume() or a step
+		bool isPaused( void ) const;
 
 	protected:
 
-		void thread( void );
+		static void thread( pi_State* state );
+		static void execute( pi_State* state );
+
+		static lua_State* openVm( pi_State* state );
+		static void closeVm( pi_State* state );
+		static void sweep( pi_State* state, lua_State* L );
+		static void record( pi_State* state, lua_State* L );
+
+		static int lua_require( lua_State* L );
+		static int lua_searcher( lua_State* L );
 
 	signals:
 
@@ -34,6 +156,13 @@ class LuaThread : public QObject
 		void fromStdOut( QString const& txt );
 		void currentLine( int n );
 
+		// sampled along with the current line while running
+		void memoryChanged( quint64 bytes );
+
+		// the vm stopped at line of chunk (see setBreakpoints), and carried on
+		void paused( QString const& chunk, int line );
+		void resumed( void );
+
 	public slots:
 
 		void start( void );
@@ -44,13 +173,66 @@ class LuaThread : public QObject
 
 		void setScript( QString const& text );
 
+		// takes ownership, see Source
+		void setScript( Source* source );
+
+		// name shown for the script in error messages and tracebacks
+		void setChunkName( QString const& name );
+
+		void setWarm( bool warm );
+		void reset( void );
+
+		void setHookQuantum( int instructions );
+
+		void setTrackingMode( TrackingMode mode );
+		void setTrackingInterval( int ms );
+
+		// load the script and modules through LuaBytecodeCache
+		void setBytecodeCache( bool enable );
+
+		// allocations growing the vm beyond this fail with a memory error
+		void setMemoryLimit( quint64 bytes );
+
+		void setProfiling( bool enable );
+		void setProfilingRate( int hz );
+
+		// applies from the next start()
+		void setBudget( LuaThread::Budget const& budget );
+
+		// Lines to pause at in a chunk: the script by chunkName(), a module by
+		// its file as package.searchpath found it. Applies straight away, also
+		// to a running script. While there are none (and nothing is being
+		// stepped) the vm runs with the count hook alone.
+		void setBreakpoints( QString const& chunk, QList<int> const& lines );
+		void clearBreakpoints( void );
+
+		// pause at the next line run; before start(), at the first one
+		void pause( void );
+
+		// while paused: carry on, or pause again at the next line (stepInto),
+		// the next line in this function or its callers (stepOver), or the
+		// next one in a caller (stepOut)
+		void resume( void );
+		void stepInto( void );
+		void stepOver( void );
+		void stepOut( void );
+
 	private slots:
 
-		void pipe_rx( void );
+		void output_flush( void );
+		void line_sample( void );
+		void watchdog_start( void );
+		void watchdog_expired( void );
+		void debug_paused( void );
 
 	private:
 
+		void shutdown( void );
+
 		pi_State *m_state;
+		QTimer* m_sampler;
+		QTimer* m_flusher;
+		QTimer* m_watchdog;
 };
 
 #endif // LUATHREAD_H
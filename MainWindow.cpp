@@ -8,6 +8,7 @@ MainWindow::MainWindow(QWidget *parent) :
 	ui->setupUi(this);
 
 	connect( ui->luaForm, &LuaForm::filename, [this](QString const& msg){ ui->statusbar->showMessage( msg ); } );
+	connect( ui->luaForm, &LuaForm::status, [this](QString const& msg){ ui->statusbar->showMessage( msg ); } );
 }
 
 MainWindow::~MainWindow()
@@ -0,0 +1,235 @@
+#include "MappedFile.h"
+
+#include <cstring>
+
+
+namespace
+{
+	// lines added to the shared index at a time
+	int const index_batch = 65536;
+}
+
+
+MappedFile::MappedFile( QObject* parent ) :
+	QObject( parent ),
+	m_data( 0 ),
+	m_size( 0 ),
+	m_longest( 0 ),
+	m_abort( false ),
+	m_done( false ),
+	m_posted( false ),
+	m_reported( false )
+{
+}
+
+
+MappedFile::~MappedFile( void )
+{
+	close();
+}
+
+
+bool MappedFile::open( QString const& filename )
+{
+	close();
+
+	m_file.setFileName( filename );
+	if( ! m_file.open( QFile::ReadOnly ) )
+	{
+		return false;
+	}
+
+	m_size = m_file.size();
+	if( m_size > 0 )
+	{
+		m_data = m_file.map( 0, m_size );
+		if( m_data == 0 )
+		{
+			m_file.close();
+			m_size = 0;
+			return false;
+		}
+	}
+
+	m_starts.clear();
+	m_starts.append( 0 );
+	m_longest = 0;
+	m_abort = false;
+	m_done = false;
+	m_posted = false;
+	m_reported = false;
+
+	m_thread = std::thread( &MappedFile::scan, this );
+	return true;
+}
+
+
+void MappedFile::close( void )
+{
+	if( m_thread.joinable() )
+	{
+		m_abort = true;
+		m_thread.join();
+	}
+
+	if( m_data )
+	{
+		m_file.unmap( m_data );
+		m_data = 0;
+	}
+
+	m_file.close();
+	m_size = 0;
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_starts.clear();
+}
+
+
+bool MappedFile::isOpen( void ) const
+{
+	return m_file.isOpen();
+}
+
+
+QString MappedFile::fileName( void ) const
+{
+	return m_file.fileName();
+}
+
+
+char const* MappedFile::data( void ) const
+{
+	return reinterpret_cast<char const*>( m_data );
+}
+
+
+qint64 MappedFile::size( void ) const
+{
+	return m_size;
+}
+
+
+int MappedFile::lineCount( void ) const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// the last start is only a line once the scan is done or it is followed by another
+	int n = m_starts.size();
+	return m_done ? n : qMax( 0, n - 1 );
+}
+
+
+qint64 MappedFile::longestLine( void ) const
+{
+	return m_longest;
+}
+
+
+bool MappedFile::isIndexed( void ) const
+{
+	return m_done;
+}
+
+
+QByteArray MappedFile::line( int n ) const
+{
+	qint64 begin;
+	qint64 end;
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( n < 0 || n >= m_starts.size() )
+		{
+			return QByteArray();
+		}
+
+		begin = m_starts.at( n );
+		end = ( n + 1 < m_starts.size() ) ? m_starts.at( n + 1 ) - 1 : m_size;
+	}
+
+	if( end > begin && m_data[end - 1] == '\r' )
+	{
+		--end;
+	}
+
+	return QByteArray( data() + begin, int( qMax( Q_INT64_C( 0 ), end - begin ) ) );
+}
+
+
+void MappedFile::scan( void )
+{
+	char const* p = data();
+	qint64 pos = 0;
+
+	qint64 longest = 0;
+
+	QVector<qint64> batch;
+	batch.reserve( index_batch );
+
+	while( pos < m_size && ! m_abort )
+	{
+		void const* nl = std::memchr( p + pos, '\n', size_t( m_size - pos ) );
+		if( nl == 0 )
+		{
+			break;
+		}
+
+		qint64 next = static_cast<char const*>( nl ) - p + 1;
+		longest = qMax( longest, next - pos - 1 );
+		pos = next;
+		batch.append( pos );
+
+		if( batch.size() == index_batch )
+		{
+			{
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_starts += batch;
+			}
+			batch.clear();
+			m_longest = longest;
+
+			if( ! m_posted.exchange( true ) )
+			{
+				QMetaObject::invokeMethod( this, "index_progress", Qt::QueuedConnection );
+			}
+		}
+	}
+
+	m_longest = qMax( longest, m_size - pos );
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_starts += batch;
+
+		// a trailing newline does not start another line
+		if( m_starts.size() > 1 && m_starts.last() == m_size )
+		{
+			m_starts.removeLast();
+		}
+	}
+
+	if( ! m_abort )
+	{
+		m_done = true;
+		QMetaObject::invokeMethod( this, "index_progress", Qt::QueuedConnection );
+	}
+}
+
+
+void MappedFile::index_progress( void )
+{
+	m_posted = false;
+
+	if( ! isOpen() )
+	{
+		return;
+	}
+
+	emit indexed( lineCount() );
+
+	if( m_done && ! m_reported )
+	{
+		m_reported = true;
+		emit finished();
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QObject>
+#include <QFile>
+#include <QVector>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#endif
+
+
+// Read-only memory mapped file with a line index.
+//
+// The index of line start offsets is built on a background thread after
+// open(); lines become available to line() as the scan progresses.
+class MappedFile : public QObject
+{
+	Q_OBJECT
+
+	public:
+
+		explicit MappedFile( QObject* parent = 0 );
+		~MappedFile( void );
+
+		bool open( QString const& filename );
+		void close( void );
+
+		bool isOpen( void ) const;
+		QString fileName( void ) const;
+
+		char const* data( void ) const;
+		qint64 size( void ) const;
+
+		// lines indexed so far, and whether the scan has finished
+		int lineCount( void ) const;
+		bool isIndexed( void ) const;
+
+		// length in bytes of the longest line indexed so far
+		qint64 longestLine( void ) const;
+
+		// raw bytes of line n without the line terminator
+		QByteArray line( int n ) const;
+
+	signals:
+
+		// emitted (queued) as the index grows
+		void indexed( int lines );
+		void finished( void );
+
+	private slots:
+
+		void index_progress( void );
+
+	private:
+
+		void scan( void );
+
+		QFile m_file;
+		uchar* m_data;
+		qint64 m_size;
+
+		std::thread m_thread;
+		mutable std::mutex m_mutex;
+		QVector<qint64> m_starts;
+		std::atomic<qint64> m_longest;
+		std::atomic<bool> m_abort;
+		std::atomic<bool> m_done;
+		std::atomic<bool> m_posted;
+		bool m_reported;		// finished() already emitted
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,322 @@
+#include "OutputView.h"
+
+#include <QtWidgets>
+#include <QTemporaryFile>
+
+
+OutputView::OutputView( QWidget* parent ) :
+	LineView( parent ),
+	m_lines( 0 ),
+	m_bytes( 0 ),
+	m_open( false ),
+	m_longest( 0 ),
+	m_maxLines( 1000000 ),
+	m_maxBytes( Q_INT64_C( 256 ) << 20 ),
+	m_spill( false ),
+	m_spillFile( 0 ),
+	m_dropped( 0 )
+{
+	updateScrollBars();
+}
+
+
+OutputView::~OutputView( void )
+{
+	delete m_spillFile;
+}
+
+
+void OutputView::setMaximumLines( int lines )
+{
+	m_maxLines = qMax( int( chunk_lines ), lines );
+	trim();
+	updateScrollBars();
+}
+
+int OutputView::maximumLines( void ) const
+{
+	return m_maxLines;
+}
+
+
+void OutputView::setMaximumBytes( qint64 bytes )
+{
+	m_maxBytes = bytes;
+	trim();
+	updateScrollBars();
+}
+
+qint64 OutputView::maximumBytes( void ) const
+{
+	return m_maxBytes;
+}
+
+
+void OutputView::setSpillToDisk( bool spill )
+{
+	m_spill = spill;
+}
+
+bool OutputView::spillToDisk( void ) const
+{
+	return m_spill;
+}
+
+
+int OutputView::lineCount( void ) const
+{
+	return m_lines;
+}
+
+
+QString OutputView::line( int n ) const
+{
+	if( n < 0 || n >= m_lines )
+	{
+		return QString();
+	}
+
+	// every chunk but the last one is full
+	return m_chunks.at( n / chunk_lines ).lines.at( n % chunk_lines );
+}
+
+
+qint64 OutputView::longestLine( void ) const
+{
+	return m_longest;
+}
+
+
+qint64 OutputView::droppedLines( void ) const
+{
+	return m_dropped;
+}
+
+
+bool OutputView::save( QString const& filename ) const
+{
+	QFile file( filename );
+	if( ! file.open( QFile::WriteOnly | QFile::Truncate ) )
+	{
+		return false;
+	}
+
+	if( m_spillFile )
+	{
+		m_spillFile->seek( 0 );
+		while( ! m_spillFile->atEnd() )
+		{
+			file.write( m_spillFile->read( 1 << 20 ) );
+		}
+	}
+
+	for( auto const& chunk : m_chunks )
+	{
+		for( auto const& text : chunk.lines )
+		{
+			file.write( text.toUtf8() );
+			file.write( "\n", 1 );
+		}
+	}
+
+	return file.error() == QFile::NoError;
+}
+
+
+void OutputView::append( QString const& text )
+{
+	if( text.isEmpty() )
+	{
+		return;
+	}
+
+	QScrollBar* vsb = verticalScrollBar();
+	bool follow = ( vsb->value() == vsb->maximum() );
+
+	int start = 0;
+	for( ;; )
+	{
+		int end = text.indexOf( QLatin1Char( '\n' ), start );
+		QString piece = text.mid( start, end < 0 ? -1 : end - start );
+
+		if( m_open )
+		{
+			// continue the unterminated last line
+			Chunk& chunk = m_chunks.last();
+			QString& last = chunk.lines.last();
+			last.append( piece );
+			chunk.bytes += piece.size() * sizeof(QChar);
+			m_bytes += piece.size() * sizeof(QChar);
+			m_longest = qMax( m_longest, last.size() );
+			m_open = false;
+		}
+		else if( end >= 0 || ! piece.isEmpty() )
+		{
+			addLine( piece );
+		}
+
+		if( end < 0 )
+		{
+			m_open = ! piece.isEmpty();
+			break;
+		}
+
+		start = end + 1;
+		if( start == text.size() )
+		{
+			break;
+		}
+	}
+
+	trim();
+	updateScrollBars();
+
+	if( follow )
+	{
+		vsb->setValue( vsb->maximum() );
+	}
+}
+
+
+void OutputView::addLine( QString const& text )
+{
+	if( m_chunks.isEmpty() || m_chunks.last().lines.size() == chunk_lines )
+	{
+		m_chunks.append( Chunk() );
+		m_chunks.last().lines.reserve( chunk_lines );
+	}
+
+	Chunk& chunk = m_chunks.last();
+	chunk.lines.append( text );
+	chunk.bytes += text.size() * sizeof(QChar);
+
+	m_bytes += text.size() * sizeof(QChar);
+	m_longest = qMax( m_longest, text.size() );
+	++m_lines;
+}
+
+
+void OutputView::trim( void )
+{
+	// always keep the chunk being written to
+	while( m_chunks.size() > 1 && ( m_lines > m_maxLines || m_bytes > m_maxBytes ) )
+	{
+		Chunk const& chunk = m_chunks.first();
+
+		if( m_spill )
+		{
+			spill( chunk );
+		}
+
+		m_lines -= chunk.lines.size();
+		m_bytes -= chunk.bytes;
+		m_dropped += chunk.lines.size();
+
+		if( m_anchor >= 0 )
+		{
+			m_anchor = qMax( 0, m_anchor - chunk_lines );
+			m_cursor = qMax( 0, m_cursor - chunk_lines );
+		}
+
+		m_chunks.removeFirst();
+
+		// keep the view on the same text while scrolled back
+		verticalScrollBar()->setValue( verticalScrollBar()->value() - chunk_lines );
+	}
+}
+
+
+void OutputView::spill( Chunk const& chunk )
+{
+	if( m_spillFile == 0 )
+	{
+		m_spillFile = new QTemporaryFile( QDir::temp().filePath( QLatin1String( "LuaEditor-output-XXXXXX.txt" ) ) );
+		if( ! m_spillFile->open() )
+		{
+			delete m_spillFile;
+			m_spillFile = 0;
+			m_spill = false;
+			return;
+		}
+	}
+
+	m_spillFile->seek( m_spillFile->size() );
+
+	QByteArray data;
+	for( auto const& text : chunk.lines )
+	{
+		data.append( text.toUtf8() );
+		data.append( '\n' );
+	}
+	m_spillFile->write( data );
+}
+
+
+void OutputView::clear( void )
+{
+	m_chunks.clear();
+	m_lines = 0;
+	m_bytes = 0;
+	m_open = false;
+	m_longest = 0;
+	m_dropped = 0;
+	m_anchor = m_cursor = -1;
+
+	delete m_spillFile;
+	m_spillFile = 0;
+
+	updateScrollBars();
+}
+
+
+void OutputView::resizeEvent( QResizeEvent* e )
+{
+	QScrollBar* vsb = verticalScrollBar();
+	bool follow = ( vsb->value() == vsb->maximum() );
+
+	LineView::resizeEvent( e );
+
+	if( follow )
+	{
+		vsb->setValue( vsb->maximum() );
+	}
+}
+
+
+void OutputView::contextMenuEvent( QContextMenuEvent* e )
+{
+	QMenu menu( this );
+
+	QAction* copyAction = menu.addAction( tr( "Copy" ), this, SLOT(copy()) );
+	copyAction->setEnabled( m_anchor >= 0 );
+	menu.addAction( tr( "Select All" ), this, SLOT(selectAll()) );
+	menu.addSeparator();
+
+	QAction* spillAction = menu.addAction( tr( "Spill Old Output to Disk" ) );
+	spillAction->setCheckable( true );
+	spillAction->setChecked( m_spill );
+	connect( spillAction, &QAction::toggled, this, &OutputView::setSpillToDisk );
+
+	QAction* saveAction = menu.addAction( tr( "Save Output As..." ) );
+	connect( saveAction, &QAction::triggered, [this]{
+		QString f = QFileDialog::getSaveFileName( this, tr( "Save Output" ), QString(), QLatin1String( "*.txt" ) );
+		if( ! f.isEmpty() && ! save( f ) )
+		{
+			QMessageBox::warning( this, tr( "Save Output" ), tr( "Could not write %1" ).arg( f ) );
+		}
+	} );
+
+	menu.addSeparator();
+	menu.addAction( tr( "Clear" ), this, SLOT(clear()) );
+
+	if( m_dropped > 0 )
+	{
+		menu.addSeparator();
+		QAction* info = menu.addAction( m_spillFile
+			? tr( "%1 earlier lines spilled to disk" ).arg( m_dropped )
+			: tr( "%1 earlier lines dropped" ).arg( m_dropped ) );
+		info->setEnabled( false );
+	}
+
+	menu.exec( e->globalPos() );
+}
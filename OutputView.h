@@ -0,0 +1,90 @@
+#ifndef OUTPUTVIEW_H
+#define OUTPUTVIEW_H
+
+#include "LineView.h"
+
+#include <QStringList>
+#include <QList>
+
+class QTemporaryFile;
+
+
+// Read-only console for script output.
+//
+// Lines are kept in fixed size chunks; once the line or byte cap is reached
+// the oldest chunk is dropped (or spilled to a temporary file) as a whole.
+// Only the lines inside the viewport are laid out when painting.
+class OutputView : public LineView
+{
+	Q_OBJECT
+
+	public:
+
+		explicit OutputView( QWidget* parent = 0 );
+		~OutputView( void );
+
+		void setMaximumLines( int lines );
+		int maximumLines( void ) const;
+
+		void setMaximumBytes( qint64 bytes );
+		qint64 maximumBytes( void ) const;
+
+		void setSpillToDisk( bool spill );
+		bool spillToDisk( void ) const;
+
+		// retained lines (excluding those dropped or spilled)
+		int lineCount( void ) const Q_DECL_OVERRIDE;
+		QString line( int n ) const Q_DECL_OVERRIDE;
+
+		// lines no longer retained in memory
+		qint64 droppedLines( void ) const;
+
+		// write the spilled and retained output to a file
+		bool save( QString const& filename ) const;
+
+	public slots:
+
+		void append( QString const& text );
+		void clear( void );
+
+	protected:
+
+		qint64 longestLine( void ) const Q_DECL_OVERRIDE;
+
+		virtual void resizeEvent( QResizeEvent* e ) Q_DECL_OVERRIDE;
+		virtual void contextMenuEvent( QContextMenuEvent* e ) Q_DECL_OVERRIDE;
+
+	private:
+
+		enum
+		{
+			chunk_lines = 4096
+		};
+
+		struct Chunk
+		{
+			Chunk( void ) : bytes( 0 ) {}
+
+			QStringList lines;
+			qint64 bytes;
+		};
+
+		void addLine( QString const& text );
+		void trim( void );
+		void spill( Chunk const& chunk );
+
+		QList<Chunk> m_chunks;
+		int m_lines;
+		qint64 m_bytes;
+		bool m_open;			// last line has no newline yet
+		int m_longest;			// in characters, for the horizontal range
+
+		int m_maxLines;
+		qint64 m_maxBytes;
+
+		bool m_spill;
+		QTemporaryFile* m_spillFile;
+		qint64 m_dropped;
+};
+
+#endif // OUTPUTVIEW_H
@@ -0,0 +1,66 @@
+#include "RingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+RingBuffer::RingBuffer( size_t capacity ) :
+	m_head( 0 ),
+	m_tail( 0 )
+{
+	size_t size = 1;
+	while( size < capacity )
+	{
+		size <<= 1;
+	}
+
+	m_data = new char[ size ];
+	m_mask = size - 1;
+}
+
+
+RingBuffer::~RingBuffer( void )
+{
+	delete[] m_data;
+}
+
+
+size_t RingBuffer::write( char const* data, size_t n )
+{
+	size_t head = m_head.load( std::memory_order_relaxed );
+	size_t tail = m_tail.load( std::memory_order_acquire );
+
+	n = std::min( n, capacity() - ( head - tail ) );
+
+	// copy in (up to) two parts, around the end of the storage
+	size_t offset = head & m_mask;
+	size_t first = std::min( n, capacity() - offset );
+	memcpy( m_data + offset, data, first );
+	memcpy( m_data, data + first, n - first );
+
+	m_head.store( head + n, std::memory_order_release );
+	return n;
+}
+
+
+size_t RingBuffer::read( char* data, size_t n )
+{
+	size_t tail = m_tail.load( std::memory_order_relaxed );
+	size_t head = m_head.load( std::memory_order_acquire );
+
+	n = std::min( n, head - tail );
+
+	size_t offset = tail & m_mask;
+	size_t first = std::min( n, capacity() - offset );
+	memcpy( data, m_data + offset, first );
+	memcpy( data + first, m_data, n - first );
+
+	m_tail.store( tail + n, std::memory_order_release );
+	return n;
+}
+
+
+size_t RingBuffer::size( void ) const
+{
+	return m_head.load( std::memory_order_acquire ) - m_tail.load( std::memory_order_acquire );
+}
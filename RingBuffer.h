@@ -0,0 +1,44 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+
+// Lock-free byte ring for exactly one producer thread and one consumer thread.
+class RingBuffer
+{
+	public:
+
+		// capacity is rounded up to a power of two
+		explicit RingBuffer( size_t capacity );
+		~RingBuffer( void );
+
+		// producer: copies as much as fits, returns the number of bytes taken
+		size_t write( char const* data, size_t n );
+
+		// consumer: copies at most n bytes out, returns the number of bytes read
+		size_t read( char* data, size_t n );
+
+		// bytes waiting to be read
+		size_t size( void ) const;
+
+		size_t capacity( void ) const
+		{
+			return m_mask + 1;
+		}
+
+	private:
+
+		RingBuffer( RingBuffer const& );
+		RingBuffer& operator=( RingBuffer const& );
+
+		char* m_data;
+		size_t m_mask;
+
+		// free running positions, only ever incremented by their owner
+		std::atomic<size_t> m_head;		// producer
+		std::atomic<size_t> m_tail;		// consumer
+};
+
+#endif // RINGBUFFER_H
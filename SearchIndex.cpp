@@ -0,0 +1,155 @@
+#include "SearchIndex.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+
+namespace
+{
+	// set the filter bit for a gram (of n characters, hashed into h)
+	inline void mark( quint64* bits, quint32 h, quint32 n )
+	{
+		h = ( h + n ) * 0x9E3779B1u;
+		bits[ h >> 30 ] |= quint64( 1 ) << ( ( h >> 24 ) & 63 );
+	}
+
+	// calls mark() for every 1, 2 and 3 character gram of text
+	void grams( quint64* bits, QString const& text )
+	{
+		quint32 c1 = 0, c2 = 0;
+		for( int i = 0; i < text.size(); ++i )
+		{
+			quint32 c = text.at( i ).toCaseFolded().unicode();
+			mark( bits, c, 1 );
+			if( i >= 1 )
+			{
+				mark( bits, ( c1 << 16 ) ^ c, 2 );
+			}
+			if( i >= 2 )
+			{
+				mark( bits, ( c2 << 20 ) ^ ( c1 << 10 ) ^ c, 3 );
+			}
+			c2 = c1;
+			c1 = c;
+		}
+	}
+}
+
+
+SearchIndex::SearchIndex( QTextDocument* document ) :
+	QObject( document ),
+	m_document( document )
+{
+	Signature empty = {};
+	m_blocks.fill( empty, document->blockCount() );
+
+	connect( document, &QTextDocument::contentsChange, this, &SearchIndex::contentsChange );
+}
+
+
+void SearchIndex::build( Signature& sig, QString const& text )
+{
+	sig.bits[0] = sig.bits[1] = sig.bits[2] = sig.bits[3] = 0;
+	grams( sig.bits, text );
+	sig.valid = true;
+}
+
+
+void SearchIndex::contentsChange( int position, int removed, int added )
+{
+	Q_UNUSED( removed );
+
+	int count = m_document->blockCount();
+	int first = m_document->findBlock( position ).blockNumber();
+	QTextBlock end = m_document->findBlock( position + added );
+	int last = end.isValid() ? end.blockNumber() : count - 1;
+
+	if( first < 0 || first >= m_blocks.size() )
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	// blocks first..last replace first..last-delta in the old numbering
+	int delta = count - m_blocks.size();
+	int old = qBound( 0, last - delta - first + 1, m_blocks.size() - first );
+
+	Signature empty = {};
+	m_blocks.remove( first, old );
+	m_blocks.insert( first, last - first + 1, empty );
+
+	if( m_blocks.size() != count )
+	{
+		// out of step somehow, start over
+		m_blocks.clear();
+		m_blocks.fill( empty, count );
+	}
+}
+
+
+QVector<SearchIndex::Match> SearchIndex::find( QString const& text, Qt::CaseSensitivity cs )
+{
+	QVector<Match> out;
+	if( text.isEmpty() || text.contains( QChar::ParagraphSeparator ) || text.contains( QLatin1Char( '\n' ) ) )
+	{
+		return out;
+	}
+
+	quint64 want[4] = { 0, 0, 0, 0 };
+	grams( want, text );
+
+	int n = 0;
+	for( QTextBlock block = m_document->begin(); block.isValid() && n < m_blocks.size(); block = block.next(), ++n )
+	{
+		Signature& sig = m_blocks[n];
+
+		QString line;
+		if( ! sig.valid )
+		{
+			line = block.text();
+			build( sig, line );
+		}
+
+		if( ( sig.bits[0] & want[0] ) != want[0] || ( sig.bits[1] & want[1] ) != want[1] ||
+			( sig.bits[2] & want[2] ) != want[2] || ( sig.bits[3] & want[3] ) != want[3] )
+		{
+			continue;
+		}
+
+		if( line.isNull() )
+		{
+			line = block.text();
+		}
+
+		for( int at = line.indexOf( text, 0, cs ); at >= 0; at = line.indexOf( text, at + text.size(), cs ) )
+		{
+			Match m = { block.position() + at, text.size() };
+			out.append( m );
+		}
+	}
+
+	return out;
+}
+
+
+int SearchIndex::replaceAll( QString const& text, QString const& with, Qt::CaseSensitivity cs )
+{
+	QVector<Match> matches = find( text, cs );
+	if( matches.isEmpty() )
+	{
+		return 0;
+	}
+
+	// back to front, so earlier positions stay put
+	QTextCursor cursor( m_document );
+	cursor.beginEditBlock();
+	for( int i = matches.size() - 1; i >= 0; --i )
+	{
+		cursor.setPosition( matches[i].position );
+		cursor.setPosition( matches[i].position + matches[i].length, QTextCursor::KeepAnchor );
+		cursor.insertText( with );
+	}
+	cursor.endEditBlock();
+
+	return matches.size();
+}
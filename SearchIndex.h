@@ -0,0 +1,55 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class QTextDocument;
+
+// Finds text in a document without reading every line of it.
+//
+// Each block keeps a small bloom filter of the case folded characters, pairs
+// and triples it contains. A search only reads the blocks whose filter holds
+// every gram of the query, so on a large document most lines are ruled out
+// from the index alone. Filters of edited blocks are dropped on contentsChange
+// and rebuilt by the next search.
+class SearchIndex : public QObject
+{
+	Q_OBJECT
+
+	public:
+
+		struct Match
+		{
+			int position;
+			int length;
+		};
+
+		explicit SearchIndex( QTextDocument* document );
+
+		// all matches in document order, within one line each
+		QVector<Match> find( QString const& text, Qt::CaseSensitivity cs = Qt::CaseInsensitive );
+
+		// replace every match in one edit block (one undo step), returns the count
+		int replaceAll( QString const& text, QString const& with, Qt::CaseSensitivity cs = Qt::CaseInsensitive );
+
+	private slots:
+
+		void contentsChange( int position, int removed, int added );
+
+	private:
+
+		struct Signature
+		{
+			quint64 bits[4];
+			bool valid;
+		};
+
+		static void build( Signature& sig, QString const& text );
+
+		QTextDocument* m_document;
+		QVector<Signature> m_blocks;	// by block number
+};
+
+#endif // SEARCHINDEX_H
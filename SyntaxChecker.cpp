@@ -0,0 +1,224 @@
+#include "SyntaxChecker.h"
+
+#include <lua.hpp>
+
+#include <QRegularExpression>
+#include <QTextDocument>
+#include <QTimer>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#endif
+
+namespace
+{
+	enum
+	{
+		piece_bytes = 64 * 1024,		// handed to the parser at a time
+		delay_ms = 300,					// after the last edit
+		delay_large_ms = 1000,			// the same, past large_chars
+		large_chars = 1024 * 1024
+	};
+}
+
+
+struct SyntaxChecker::pi_Worker
+{
+	struct Reader
+	{
+		pi_Worker* worker;
+		quint64 generation;
+		QByteArray const* text;
+		int pos;
+	};
+
+	pi_Worker( SyntaxChecker* parent ) :
+		owner( parent ),
+		generation( 0 ),
+		quit( false ),
+		pending( false ),
+		checked( 0 ),
+		line( 0 )
+	{
+		thread = std::thread( &pi_Worker::run, this );
+	}
+
+	~pi_Worker( void )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			quit = true;
+			++generation;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	// abandon the check in flight
+	void cancel( void )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		++generation;
+		pending = false;
+	}
+
+	void submit( QString const& text )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			++generation;
+			source = text;
+			pending = true;
+		}
+		wake.notify_all();
+	}
+
+	// stops handing out text once a newer edit has arrived
+	static char const* read( lua_State* L, void* data, size_t* size )
+	{
+		(void) L;
+		Reader* r = static_cast<Reader*>( data );
+		if( r->generation != r->worker->generation.load( std::memory_order_relaxed ) )
+		{
+			*size = 0;
+			return 0;
+		}
+
+		int n = qMin<int>( r->text->size() - r->pos, piece_bytes );
+		char const* p = r->text->constData() + r->pos;
+		r->pos += n;
+		*size = size_t( n );
+		return p;
+	}
+
+	void run( void )
+	{
+		lua_State* L = luaL_newstate();
+
+		std::unique_lock<std::mutex> lock( mutex );
+		for( ;; )
+		{
+			wake.wait( lock, [this]{ return quit || pending; } );
+			if( quit )
+			{
+				break;
+			}
+
+			pending = false;
+			quint64 g = generation;
+			QByteArray text = source.toUtf8();
+			source.clear();
+			lock.unlock();
+
+			// the chunk name is stripped from the message below; text only,
+			// bytecode is not verified and a bad chunk could crash the editor
+			Reader reader{ this, g, &text, 0 };
+			int err = lua_load( L, &pi_Worker::read, &reader, "=script", "t" );
+
+			int errline = 0;
+			QString message;
+			if( err == LUA_ERRSYNTAX )
+			{
+				// "name:line: message"
+				message = QString::fromUtf8( lua_tostring( L, -1 ) );
+				static QRegularExpression const re( QStringLiteral( "^.*?:(\\d+): (.*)$" ), QRegularExpression::DotMatchesEverythingOption );
+				QRegularExpressionMatch m = re.match( message );
+				if( m.hasMatch() )
+				{
+					errline = m.captured( 1 ).toInt();
+					message = m.captured( 2 );
+				}
+			}
+			lua_settop( L, 0 );
+			lua_gc( L, LUA_GCCOLLECT, 0 );
+
+			lock.lock();
+			if( g == generation && ! quit )
+			{
+				line = errline;
+				error = message;
+				checked = g;
+				QMetaObject::invokeMethod( owner, "deliver", Qt::QueuedConnection );
+			}
+		}
+		lock.unlock();
+
+		lua_close( L );
+	}
+
+	SyntaxChecker* owner;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<quint64> generation;
+	bool quit;
+
+	// next check, under mutex
+	bool pending;
+	QString source;
+
+	// last result, under mutex
+	quint64 checked;
+	int line;
+	QString error;
+};
+
+
+SyntaxChecker::SyntaxChecker( QTextDocument* document ) :
+	QObject( document ),
+	m_document( document )
+{
+	m_timer = new QTimer( this );
+	m_timer->setSingleShot( true );
+	connect( m_timer, &QTimer::timeout, this, &SyntaxChecker::check );
+
+	m_worker = new pi_Worker( this );
+
+	connect( document, &QTextDocument::contentsChanged, this, &SyntaxChecker::contentsChanged );
+}
+
+
+SyntaxChecker::~SyntaxChecker( void )
+{
+	delete m_worker;
+}
+
+
+void SyntaxChecker::check( void )
+{
+	m_timer->stop();
+	m_worker->submit( m_document->toPlainText() );
+}
+
+
+void SyntaxChecker::contentsChanged( void )
+{
+	// the old result is about to be stale, don't let it arrive
+	m_worker->cancel();
+	m_timer->start( m_document->characterCount() > large_chars ? delay_large_ms : delay_ms );
+}
+
+
+void SyntaxChecker::deliver( void )
+{
+	int line;
+	QString message;
+	{
+		std::lock_guard<std::mutex> lock( m_worker->mutex );
+		if( m_worker->checked != m_worker->generation )
+		{
+			return;		// edited since
+		}
+		line = m_worker->line;
+		message = m_worker->error;
+	}
+
+	emit checked( line, message );
+}
@@ -0,0 +1,49 @@
+#ifndef SYNTAXCHECKER_H
+#define SYNTAXCHECKER_H
+
+#include <QObject>
+#include <QString>
+
+class QTextDocument;
+class QTimer;
+
+// Compiles the document in a scratch lua_State on a worker thread, a moment
+// after the last edit, and reports the first syntax error. Nothing is run.
+//
+// A check in flight is abandoned as soon as the document changes again: the
+// parser is fed through a reader that stops handing out text once the check
+// is stale, so even a large file never holds up the next one.
+class SyntaxChecker : public QObject
+{
+	Q_OBJECT
+
+	struct pi_Worker;
+
+	public:
+
+		explicit SyntaxChecker( QTextDocument* document );
+		~SyntaxChecker( void );
+
+	public slots:
+
+		// check now instead of waiting for the next edit
+		void check( void );
+
+	signals:
+
+		// line is 1 based, 0 when the text compiles
+		void checked( int line, QString const& message );
+
+	private slots:
+
+		void contentsChanged( void );
+		void deliver( void );
+
+	private:
+
+		QTextDocument* m_document;
+		QTimer* m_timer;
+		pi_Worker* m_worker;
+};
+
+#endif // SYNTAXCHECKER_H
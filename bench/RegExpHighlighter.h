@@ -0,0 +1,43 @@
+#ifndef REGEXPHIGHLIGHTER_H
+#define REGEXPHIGHLIGHTER_H
+
+#include <QSyntaxHighlighter>
+#include <QTextCharFormat>
+
+class QTextDocument;
+
+// The per-rule QRegExp highlighter LuaHighlighter replaced, kept as the
+// baseline for the lexer and highlight benchmarks.
+class RegExpHighlighter : public QSyntaxHighlighter
+{
+	public:
+		RegExpHighlighter( QTextDocument* parent = 0 );
+
+		// every rule over one line, without a document to format;
+		// returns the state for the next line
+		int scan( QString const& text, int state ) const;
+
+	protected:
+		void highlightBlock( QString const& text ) Q_DECL_OVERRIDE;
+
+	private:
+		struct HighlightingRule
+		{
+			QRegExp pattern;
+			QTextCharFormat format;
+		};
+		QVector<HighlightingRule> highlightingRules;
+
+		QRegExp commentStartExpression;
+		QRegExp commentEndExpression;
+		QRegExp quoteStartExpression;
+		QRegExp quoteEndExpression;
+
+		QTextCharFormat keywordFormat;
+		QTextCharFormat valueFormat;
+		QTextCharFormat singleLineCommentFormat;
+		QTextCharFormat quotationFormat;
+		QTextCharFormat functionFormat;
+};
+
+#endif // REGEXPHIGHLIGHTER_H
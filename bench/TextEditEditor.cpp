@@ -0,0 +1,361 @@
+#include "TextEditEditor.h"
+
+#include <QtWidgets>
+#include <QTextCursor>
+
+
+TextEditEditor::TextEditEditor(QWidget *parent) : QTextEdit(parent),
+	m_visibleFirst( -1 ),
+	m_visibleLast( -1 ),
+	m_scroll( 0 ),
+	m_blockCount( 1 )
+{
+	lineNumberArea = new TextEditLineNumberArea(this);
+
+	// the gutter only depends on scrolling and on the text itself, not on
+	// the cursor, so edits repaint just the rows they touched
+	connect( this->document(), &QTextDocument::blockCountChanged, this, &TextEditEditor::updateLineNumberAreaWidth );
+	connect( this->document(), &QTextDocument::contentsChange, this, &TextEditEditor::documentChanged );
+	connect( this->verticalScrollBar(), &QScrollBar::valueChanged, this, &TextEditEditor::updateLineNumberArea );
+
+	connect( this, &QTextEdit::cursorPositionChanged, this, &TextEditEditor::highlightCurrentLine );
+
+	updateLineNumberAreaWidth(0);
+	highlightCurrentLine();
+}
+
+
+int TextEditEditor::lineNumberAreaWidth()
+{
+	int digits = 1;
+
+	int max = qMax(1, document()->blockCount());
+	while (max >= 10) {
+		max /= 10;
+		++digits;
+	}
+
+	int space = 6 + fontMetrics().width(QLatin1Char('9')) * digits;
+
+	return space;
+}
+
+
+
+void TextEditEditor::updateLineNumberAreaWidth(int /* newBlockCount */)
+{
+	setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+}
+
+
+
+void TextEditEditor::updateLineNumberArea()
+{
+	// Make sure the sliderPosition triggers one last time the valueChanged() signal with the actual value !!!!
+	verticalScrollBar()->setSliderPosition( verticalScrollBar()->sliderPosition() );
+
+	// Since "QTextEdit" does not have an "updateRequest(...)" signal, we chose
+	// to grab the imformations from "sliderPosition()" and "contentsRect()".
+	// See the necessary connections used (Class constructor implementation part).
+
+	int dy = m_scroll - verticalScrollBar()->sliderPosition();
+	m_scroll = verticalScrollBar()->sliderPosition();
+
+	// small scrolls move what is already drawn and only paint the exposed strip
+	if( dy != 0 && qAbs( dy ) < lineNumberArea->height() )
+	{
+		lineNumberArea->scroll( 0, dy );
+	}
+	else
+	{
+		QRect crect = contentsRect();
+		lineNumberArea->update( 0, crect.y(), lineNumberArea->width(), crect.height() );
+	}
+
+	updateVisibleBlocks();
+}
+
+
+
+void TextEditEditor::documentChanged( int position, int removed, int added )
+{
+	Q_UNUSED( removed );
+
+	QTextDocument* doc = document();
+	QTextBlock first = doc->findBlock( position );
+	QTextBlock last = doc->findBlock( position + added );
+
+	int count = doc->blockCount();
+	bool shifted = ( count != m_blockCount );
+	m_blockCount = count;
+
+	QRect crect = contentsRect();
+	int top = first.isValid() ? qMax( crect.top(), int( blockTop( first ) ) ) : crect.top();
+	int bottom = crect.bottom();
+
+	// lines below only renumber when blocks were added or removed
+	if( ! shifted && last.isValid() )
+	{
+		QRectF box = doc->documentLayout()->blockBoundingRect( last );
+		bottom = qMin( bottom, int( blockTop( last ) + box.height() ) + 1 );
+	}
+
+	if( top <= bottom )
+	{
+		lineNumberArea->update( 0, top, lineNumberArea->width(), bottom - top + 1 );
+	}
+
+	updateVisibleBlocks();
+}
+
+
+
+void TextEditEditor::resizeEvent(QResizeEvent *e)
+{
+	QTextEdit::resizeEvent(e);
+
+	QRect cr = contentsRect();
+	lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
+
+	updateVisibleBlocks();
+}
+
+
+void TextEditEditor::keyPressEvent(QKeyEvent *e)
+{
+	if( e->key() == Qt::Key_S )
+	{
+		if( e->modifiers() == Qt::ControlModifier )
+		{
+			e->accept();
+			emit requestSave();
+			return;
+		}
+	}
+
+	if( e->key() == Qt::Key_Tab )
+	{
+		if( increaseSelectionIndent() )
+		{
+			e->accept();
+			return;
+		}
+	}
+
+	QTextEdit::keyPressEvent( e );
+}
+
+
+void TextEditEditor::changeEvent( QEvent* e )
+{
+	QTextEdit::changeEvent( e );
+
+	if( e->type() == QEvent::PaletteChange )
+	{
+		highlightCurrentLine();
+	}
+
+	if( e->type() == QEvent::FontChange )
+	{
+		m_numbers.clear();
+		updateLineNumberAreaWidth( 0 );
+	}
+}
+
+
+void TextEditEditor::highlightCurrentLine()
+{
+	QList<QTextEdit::ExtraSelection> extraSelections;
+
+	if( !isReadOnly() )
+	{
+		QTextEdit::ExtraSelection selection;
+
+		QColor lineColor = palette().color( QPalette::Base ).darker( 110 );
+
+		selection.format.setBackground( lineColor );
+		selection.format.setProperty( QTextFormat::FullWidthSelection, true );
+		selection.cursor = textCursor();
+		selection.cursor.clearSelection();
+		extraSelections.append( selection );
+	}
+
+	setExtraSelections( extraSelections );
+}
+
+
+QTextBlock TextEditEditor::findFirstVisibleBlock( void )
+{
+	QTextDocument* doc = document();
+	QAbstractTextDocumentLayout* layout = doc->documentLayout();
+
+	qreal top = verticalScrollBar()->sliderPosition();
+
+	// blocks are laid out top to bottom, so bisect on block number for the
+	// first one reaching below the top of the viewport
+	int lo = 0;
+	int hi = doc->blockCount() - 1;
+
+	while( lo < hi )
+	{
+		int mid = lo + ( hi - lo ) / 2;
+		QRectF box = layout->blockBoundingRect( doc->findBlockByNumber( mid ) );
+
+		if( box.bottom() <= top )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return doc->findBlockByNumber( lo );
+}
+
+
+qreal TextEditEditor::blockTop( QTextBlock const& block )
+{
+	QTextDocument* doc = document();
+
+	return viewport()->geometry().top()
+			+ doc->documentMargin()
+			- 5
+			- verticalScrollBar()->sliderPosition()
+			+ doc->documentLayout()->blockBoundingRect( block ).top();
+}
+
+
+void TextEditEditor::updateVisibleBlocks( void )
+{
+	QTextBlock block = findFirstVisibleBlock();
+	if( ! block.isValid() )
+	{
+		return;
+	}
+
+	QAbstractTextDocumentLayout* layout = document()->documentLayout();
+	qreal bottom = verticalScrollBar()->sliderPosition() + viewport()->height();
+
+	int first = block.blockNumber();
+	int last = first;
+
+	for( block = block.next(); block.isValid(); block = block.next() )
+	{
+		if( layout->blockBoundingRect( block ).top() > bottom )
+		{
+			break;
+		}
+		last = block.blockNumber();
+	}
+
+	if( first != m_visibleFirst || last != m_visibleLast )
+	{
+		m_visibleFirst = first;
+		m_visibleLast = last;
+		emit visibleBlocksChanged( first, last );
+	}
+}
+
+
+
+void TextEditEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
+{
+	QPainter painter( lineNumberArea );
+	painter.fillRect( event->rect(), Qt::lightGray );
+	painter.setPen( Qt::black );
+
+	QAbstractTextDocumentLayout* layout = document()->documentLayout();
+
+	QTextBlock block = findFirstVisibleBlock();
+	int blockNumber = block.blockNumber();
+
+	QRectF box( 0, blockTop( block ), lineNumberArea->width() - 3, 1 );
+
+	while( block.isValid() && box.top() <= event->rect().bottom() )
+	{
+		box.setHeight( layout->blockBoundingRect( block ).height() );
+		++blockNumber;
+
+		if( block.isVisible() && box.bottom() >= event->rect().top() )
+		{
+			auto it = m_numbers.find( blockNumber );
+			if( it == m_numbers.end() )
+			{
+				// keep the cache around a few screens worth of numbers
+				if( m_numbers.size() > 4096 )
+				{
+					m_numbers.clear();
+				}
+
+				QStaticText text( QString::number( blockNumber ) );
+				text.setTextFormat( Qt::PlainText );
+				text.prepare( QTransform(), lineNumberArea->font() );
+				it = m_numbers.insert( blockNumber, text );
+			}
+
+			painter.drawStaticText( QPointF( box.right() - it->size().width(), box.top() ), *it );
+		}
+
+		block = block.next();
+		box.translate( 0, box.height() );
+	}
+}
+
+
+bool TextEditEditor::increaseSelectionIndent( void )
+{
+	QTextCursor cursor( textCursor() );
+	if( ! cursor.hasSelection() )
+	{
+		return false;
+	}
+
+	int start = cursor.anchor();
+	int end = cursor.position();
+
+	if( start > end )
+	{
+		qSwap( start, end );
+	}
+
+	// get count of blocks involved
+	cursor.setPosition( end, QTextCursor::MoveAnchor );
+	int eblock = cursor.block().blockNumber();
+	cursor.setPosition( start, QTextCursor::MoveAnchor );
+	int sblock = cursor.block().blockNumber();
+
+	// single line of text, not block indent mode
+	if( sblock == eblock )
+	{
+		cursor.insertText( QLatin1String( "\t" ) );
+		return true;
+	}
+
+	int bcount = eblock - sblock + 1;
+
+	// begin inserting tabs
+	cursor.beginEditBlock();
+	for( int i = 0; i < bcount; ++i )
+	{
+		cursor.movePosition( QTextCursor::StartOfBlock, QTextCursor::MoveAnchor );
+		cursor.insertText( QLatin1String( "\t" ) );
+		cursor.movePosition( QTextCursor::NextBlock, QTextCursor::MoveAnchor );
+	}
+	cursor.endEditBlock();
+
+	// reselect the indented block
+	cursor.setPosition( start, QTextCursor::MoveAnchor );
+	cursor.movePosition( QTextCursor::StartOfBlock, QTextCursor::MoveAnchor );
+	while( cursor.block().blockNumber() < eblock )
+	{
+		cursor.movePosition( QTextCursor::NextBlock, QTextCursor::KeepAnchor );
+	}
+	cursor.movePosition( QTextCursor::EndOfBlock, QTextCursor::KeepAnchor );
+
+	setTextCursor( cursor );
+
+	return true;
+}
+
@@ -0,0 +1,94 @@
+#ifndef TEXTEDITEDITOR_H
+#define TEXTEDITEDITOR_H
+
+#include <QTextEdit>
+#include <QObject>
+#include <QHash>
+#include <QStaticText>
+
+class QPaintEvent;
+class QResizeEvent;
+class QSize;
+class QWidget;
+
+class TextEditLineNumberArea;
+
+
+// CodeEditor as it was on QTextEdit, before the move to QPlainTextEdit,
+// kept as the baseline for the open, scroll and typing benchmarks.
+class TextEditEditor : public QTextEdit
+{
+	Q_OBJECT
+
+	public:
+
+		TextEditEditor(QWidget *parent = 0);
+
+		void lineNumberAreaPaintEvent(QPaintEvent *event);
+		int lineNumberAreaWidth();
+
+	signals:
+
+		void requestSave( void );
+
+		// range of block numbers currently on screen
+		void visibleBlocksChanged( int first, int last );
+
+	protected:
+
+		virtual void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
+		virtual void keyPressEvent(QKeyEvent *e) Q_DECL_OVERRIDE;
+		virtual void changeEvent(QEvent* e ) Q_DECL_OVERRIDE;
+
+		QTextBlock findFirstVisibleBlock( void );
+		qreal blockTop( QTextBlock const& block );
+		void updateVisibleBlocks( void );
+
+	public slots:
+
+		bool increaseSelectionIndent( void );
+
+	private slots:
+
+		void updateLineNumberAreaWidth(int newBlockCount);
+		void highlightCurrentLine();
+		void updateLineNumberArea();
+		void documentChanged( int position, int removed, int added );
+
+	private:
+
+		QWidget *lineNumberArea;
+
+		int m_visibleFirst;
+		int m_visibleLast;
+
+		int m_scroll;
+		int m_blockCount;
+
+		// prepared line numbers, dropped when the font changes
+		QHash<int, QStaticText> m_numbers;
+};
+
+
+class TextEditLineNumberArea : public QWidget
+{
+	public:
+		TextEditLineNumberArea(TextEditEditor *editor) : QWidget(editor) {
+			codeEditor = editor;
+		}
+
+		QSize sizeHint() const Q_DECL_OVERRIDE {
+			return QSize(codeEditor->lineNumberAreaWidth(), 0);
+		}
+
+	protected:
+		void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE {
+			codeEditor->lineNumberAreaPaintEvent(event);
+		}
+
+	private:
+		TextEditEditor *codeEditor;
+};
+
+
+#endif
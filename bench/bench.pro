@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Editor and vm benchmarks over generated Lua files (QtTest QBENCHMARK)
+#
+#   bench [--json results.json] [testlib options]
+#
+#-------------------------------------------------
+
+QT       += core gui widgets testlib
+
+TARGET = bench
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../engine.pri)
+include(../widgets.pri)
+
+SOURCES += main.cpp \
+	RegExpHighlighter.cpp \
+	TextEditEditor.cpp
+
+HEADERS += RegExpHighlighter.h \
+	TextEditEditor.h
@@ -0,0 +1,587 @@
+#include <QtTest>
+#include <QApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QScrollBar>
+#include <QTemporaryDir>
+#include <QTemporaryFile>
+#include <QTextBlock>
+#include <QTextDocument>
+
+#include <climits>
+
+#include "CodeEditor.h"
+#include "LuaForm.h"
+#include "LuaHighlighter.h"
+#include "LuaLexer.h"
+#include "LuaStructure.h"
+#include "LuaThread.h"
+#include "RegExpHighlighter.h"
+#include "TextEditEditor.h"
+
+
+namespace
+{
+	// Deterministic Lua source of exactly `lines` lines: functions, control
+	// flow, strings, comments and multi-line long strings/comments, so the
+	// lexer state carries from block to block as in real code.
+	QString corpus( int lines )
+	{
+		static QHash<int, QString> made;
+		auto it = made.constFind( lines );
+		if( it != made.constEnd() )
+		{
+			return *it;
+		}
+
+		quint32 seed = 12345;
+		auto next = [&seed]( int n ){
+			seed = seed * 1103515245u + 12345u;
+			return int( ( seed >> 16 ) % quint32( n ) );
+		};
+
+		QStringList out;
+		out.reserve( lines );
+		int depth = 0;
+		while( out.size() < lines )
+		{
+			QString indent( depth, QLatin1Char( '\t' ) );
+			int n = out.size();
+
+			switch( next( 10 ) )
+			{
+				case 0:
+					out << indent + QStringLiteral( "function f%1( a, b, c )" ).arg( n );
+					++depth;
+					break;
+				case 1:
+					out << indent + QStringLiteral( "if v%1 > 10 and not done then" ).arg( next( 100 ) );
+					++depth;
+					break;
+				case 2:
+					if( depth > 0 )
+					{
+						--depth;
+						out << QString( depth, QLatin1Char( '\t' ) ) + QStringLiteral( "end" );
+						break;
+					}
+					// fall through
+				case 3:
+					out << indent + QStringLiteral( "-- comment on line %1 about nothing in particular" ).arg( n );
+					break;
+				case 4:
+					out << indent + QStringLiteral( "print( \"string %1 with \\\"escapes\\\"\", v%2 )" ).arg( n ).arg( next( 100 ) );
+					break;
+				case 5:
+					out << indent + QStringLiteral( "--[[ block comment %1" ).arg( n );
+					out << QStringLiteral( "   spanning lines, with end and function inside" );
+					out << QStringLiteral( "]]" );
+					break;
+				case 6:
+					out << indent + QStringLiteral( "local s%1 = [[long string" ).arg( n );
+					out << QStringLiteral( "second line of the long string" );
+					out << QStringLiteral( "]]" );
+					break;
+				default:
+					out << indent + QStringLiteral( "local v%1 = v%2 + 0x%3 * math.floor( %4.5 / 3 )" )
+						.arg( n ).arg( next( 100 ) ).arg( next( 4096 ), 0, 16 ).arg( next( 1000 ) );
+					break;
+			}
+		}
+
+		while( out.size() > lines )
+		{
+			out.removeLast();
+		}
+
+		QString text = out.join( QLatin1Char( '\n' ) );
+		made.insert( lines, text );
+		return text;
+	}
+
+	void sizes( int largest )
+	{
+		QTest::addColumn<int>( "lines" );
+
+		for( int n = 1000; n <= largest; n *= 10 )
+		{
+			QTest::newRow( qPrintable( QStringLiteral( "%1k" ).arg( n / 1000 ) ) ) << n;
+		}
+	}
+}
+
+
+class EditorBench : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+
+		// LuaLexer over every line, the work behind highlightBlock
+		void lexer_data( void ) { sizes( 1000000 ); }
+		void lexer( void )
+		{
+			QFETCH( int, lines );
+			QVector<QStringRef> split = corpus( lines ).splitRef( QLatin1Char( '\n' ) );
+			QVector<LuaLexer::Token> tokens;
+
+			QBENCHMARK
+			{
+				int state = -1;
+				for( auto const& line : split )
+				{
+					tokens.clear();
+					state = LuaLexer::tokenize( line.constData(), line.size(), state, &tokens );
+				}
+			}
+		}
+
+		// the QRegExp rules LuaLexer replaced, over the same lines
+		void lexer_regexp_data( void ) { sizes( 100000 ); }
+		void lexer_regexp( void )
+		{
+			QFETCH( int, lines );
+			QVector<QStringRef> split = corpus( lines ).splitRef( QLatin1Char( '\n' ) );
+			QStringList text;
+			for( auto const& line : split )
+			{
+				text << line.toString();
+			}
+			RegExpHighlighter rules;
+
+			QBENCHMARK
+			{
+				int state = -1;
+				for( auto const& line : text )
+				{
+					state = rules.scan( line, state );
+				}
+			}
+		}
+
+		// highlightBlock over every block, treated as visible; after the first
+		// pass tokens come from the block data, so this is mostly formatting
+		// (the lexer benchmark covers tokenizing)
+		void highlight_data( void ) { sizes( 100000 ); }
+		void highlight( void )
+		{
+			QFETCH( int, lines );
+			QTextDocument doc;
+			doc.setPlainText( corpus( lines ) );
+			LuaHighlighter highlighter( &doc );
+			highlighter.setVisibleBlocks( 0, INT_MAX );
+
+			QBENCHMARK
+			{
+				highlighter.rehighlight();
+			}
+		}
+
+		// the QRegExp highlighter over every block, for comparison
+		void highlight_regexp_data( void ) { sizes( 100000 ); }
+		void highlight_regexp( void )
+		{
+			QFETCH( int, lines );
+			QTextDocument doc;
+			doc.setPlainText( corpus( lines ) );
+			RegExpHighlighter highlighter( &doc );
+
+			QBENCHMARK
+			{
+				highlighter.rehighlight();
+			}
+		}
+
+		// LuaForm's load path (mapped past the large file threshold)
+		void open_data( void ) { sizes( 1000000 ); }
+		void open( void )
+		{
+			QFETCH( int, lines );
+			QTemporaryDir dir;
+			QString name = dir.filePath( QStringLiteral( "corpus.lua" ) );
+			QFile file( name );
+			QVERIFY( file.open( QFile::WriteOnly ) );
+			file.write( corpus( lines ).toUtf8() );
+			file.close();
+
+			LuaForm form;
+			QBENCHMARK
+			{
+				QVERIFY( form.open( name ) );
+			}
+		}
+
+		// the same file read into the QTextEdit based editor, for comparison
+		void open_textedit_data( void ) { sizes( 100000 ); }
+		void open_textedit( void )
+		{
+			QFETCH( int, lines );
+			QTemporaryDir dir;
+			QString name = dir.filePath( QStringLiteral( "corpus.lua" ) );
+			QFile file( name );
+			QVERIFY( file.open( QFile::WriteOnly ) );
+			file.write( corpus( lines ).toUtf8() );
+			file.close();
+
+			TextEditEditor editor;
+			LuaHighlighter highlighter( editor.document() );
+			QBENCHMARK
+			{
+				QVERIFY( file.open( QFile::ReadOnly ) );
+				editor.setPlainText( QString::fromLocal8Bit( file.readAll() ) );
+				file.close();
+			}
+		}
+
+		// one page down, viewport and gutter repainted
+		void scroll_data( void ) { sizes( 100000 ); }
+		void scroll( void )
+		{
+			QFETCH( int, lines );
+			LuaForm form;
+			CodeEditor* editor = form.findChild<CodeEditor*>();
+			editor->setPlainText( corpus( lines ) );
+			form.resize( 1000, 800 );
+			form.show();
+			QVERIFY( QTest::qWaitForWindowExposed( &form ) );
+
+			QScrollBar* bar = editor->verticalScrollBar();
+			QBENCHMARK
+			{
+				int v = bar->value() + bar->pageStep();
+				bar->setValue( v > bar->maximum() ? 0 : v );
+				editor->repaint();
+			}
+		}
+
+		// one page down in the QTextEdit based editor, for comparison
+		void scroll_textedit_data( void ) { sizes( 100000 ); }
+		void scroll_textedit( void )
+		{
+			QFETCH( int, lines );
+			TextEditEditor editor;
+			LuaHighlighter highlighter( editor.document() );
+			connect( &editor, &TextEditEditor::visibleBlocksChanged, &highlighter, &LuaHighlighter::setVisibleBlocks );
+			editor.setPlainText( corpus( lines ) );
+			editor.resize( 1000, 800 );
+			editor.show();
+			QVERIFY( QTest::qWaitForWindowExposed( &editor ) );
+
+			QScrollBar* bar = editor.verticalScrollBar();
+			QBENCHMARK
+			{
+				int v = bar->value() + bar->pageStep();
+				bar->setValue( v > bar->maximum() ? 0 : v );
+				editor.repaint();
+			}
+		}
+
+		// the line number gutter alone
+		void gutter_data( void ) { sizes( 100000 ); }
+		void gutter( void )
+		{
+			QFETCH( int, lines );
+			CodeEditor editor;
+			editor.setPlainText( corpus( lines ) );
+			editor.resize( 1000, 800 );
+			editor.show();
+			QVERIFY( QTest::qWaitForWindowExposed( &editor ) );
+			editor.verticalScrollBar()->setValue( editor.verticalScrollBar()->maximum() / 2 );
+
+			QWidget* area = editor.findChild<QWidget*>( QStringLiteral( "lineNumberArea" ) );
+			QVERIFY( area );
+			QBENCHMARK
+			{
+				area->repaint();
+			}
+		}
+
+		// a keystroke in the middle of the document, with everything LuaForm hangs off it
+		void typing_data( void ) { sizes( 100000 ); }
+		void typing( void )
+		{
+			QFETCH( int, lines );
+			LuaForm form;
+			CodeEditor* editor = form.findChild<CodeEditor*>();
+			editor->setPlainText( corpus( lines ) );
+			form.resize( 1000, 800 );
+			form.show();
+			QVERIFY( QTest::qWaitForWindowExposed( &form ) );
+
+			QTextCursor cursor( editor->document()->findBlockByNumber( lines / 2 ) );
+			editor->setTextCursor( cursor );
+			editor->centerCursor();
+
+			QBENCHMARK
+			{
+				QTest::keyClick( editor, Qt::Key_X );
+				QCoreApplication::processEvents();
+			}
+		}
+
+		// a keystroke in the middle of the QTextEdit based editor, for comparison
+		void typing_textedit_data( void ) { sizes( 100000 ); }
+		void typing_textedit( void )
+		{
+			QFETCH( int, lines );
+			TextEditEditor editor;
+			LuaHighlighter highlighter( editor.document() );
+			connect( &editor, &TextEditEditor::visibleBlocksChanged, &highlighter, &LuaHighlighter::setVisibleBlocks );
+			editor.setPlainText( corpus( lines ) );
+			editor.resize( 1000, 800 );
+			editor.show();
+			QVERIFY( QTest::qWaitForWindowExposed( &editor ) );
+
+			QTextCursor cursor( editor.document()->findBlockByNumber( lines / 2 ) );
+			editor.setTextCursor( cursor );
+			editor.ensureCursorVisible();
+
+			QBENCHMARK
+			{
+				QTest::keyClick( &editor, Qt::Key_X );
+				QCoreApplication::processEvents();
+			}
+		}
+
+		// increaseSelectionIndent over the whole document, and its undo
+		void indent_data( void ) { sizes( 100000 ); }
+		void indent( void )
+		{
+			QFETCH( int, lines );
+			CodeEditor editor;
+			editor.setPlainText( corpus( lines ) );
+
+			QBENCHMARK
+			{
+				editor.selectAll();
+				QVERIFY( editor.increaseSelectionIndent() );
+				editor.undo();
+			}
+		}
+
+		// a line opening a block inserted mid-document and undone, with the
+		// structure kept up to date and queried for the new block's end
+		void structure_data( void ) { sizes( 100000 ); }
+		void structure( void )
+		{
+			QFETCH( int, lines );
+			QTextDocument doc;
+			doc.setPlainText( corpus( lines ) );
+			LuaStructure structure( &doc );
+
+			// the initial pass is done in idle chunks
+			for( int i = 0; i <= lines / 1000; ++i )
+			{
+				QCoreApplication::processEvents();
+			}
+
+			QTextCursor cursor( doc.findBlockByNumber( lines / 2 ) );
+			LuaStructure::Token token;
+			QVector<LuaStructure::Token> partners;
+
+			QBENCHMARK
+			{
+				cursor.insertText( QStringLiteral( "do\n" ) );
+				QVERIFY( structure.match( cursor.position() - 1, &token, &partners ) );
+				structure.foldEnd( lines / 2 );
+				doc.undo();
+			}
+		}
+
+		// a long comment opened near the top and undone: every line after it
+		// changes state, far more than contentsChange relexes, so the rest is
+		// picked up in idle passes until the last block stops being foldable
+		void structure_cascade_data( void ) { sizes( 100000 ); }
+		void structure_cascade( void )
+		{
+			QFETCH( int, lines );
+			QTextDocument doc;
+			doc.setPlainText( corpus( lines ) );
+			LuaStructure structure( &doc );
+
+			for( int i = 0; i <= lines / 1000; ++i )
+			{
+				QCoreApplication::processEvents();
+			}
+
+			int last = lines - 1;
+			while( last > 0 && ! structure.isFoldable( last ) )
+			{
+				--last;
+			}
+			QVERIFY( last > 1 );
+
+			// the corpus has no ]=] to close it
+			QTextCursor cursor( doc.findBlockByNumber( 1 ) );
+			int passes = lines / 1000 + 2;
+
+			QBENCHMARK
+			{
+				cursor.insertText( QStringLiteral( "--[=[\n" ) );
+				for( int i = 0; i < passes && structure.isFoldable( last + 1 ); ++i )
+				{
+					QCoreApplication::processEvents();
+				}
+				QVERIFY( ! structure.isFoldable( last + 1 ) );
+
+				doc.undo();
+				for( int i = 0; i < passes && ! structure.isFoldable( last ); ++i )
+				{
+					QCoreApplication::processEvents();
+				}
+				QVERIFY( structure.isFoldable( last ) );
+			}
+		}
+
+		// print() through the output ring to fromStdOut, 80 byte lines
+		void output_data( void ) { sizes( 1000000 ); }
+		void output( void )
+		{
+			QFETCH( int, lines );
+			LuaThread vm;
+			vm.setTrackingMode( LuaThread::NoTracking );
+			vm.setBytecodeCache( false );
+
+			qint64 chars = 0;
+			connect( &vm, &LuaThread::fromStdOut, [&chars]( QString const& text ){
+				chars += text.size();
+			} );
+
+			QSignalSpy stopped( &vm, &LuaThread::stopped );
+			QBENCHMARK
+			{
+				chars = 0;
+				vm.setScript( QStringLiteral( "local s = string.rep( 'x', 79 ) for i = 1, %1 do print( s ) end" ).arg( lines ) );
+				vm.start();
+				QVERIFY( stopped.wait( 120000 ) );
+			}
+
+			QCOMPARE( chars, qint64( lines ) * 80 );
+		}
+};
+
+
+namespace
+{
+	QStringList csvFields( QString const& line )
+	{
+		QStringList fields;
+		QString field;
+		bool quoted = false;
+		for( QChar c : line )
+		{
+			if( c == QLatin1Char( '"' ) )
+			{
+				quoted = ! quoted;
+			}
+			else if( c == QLatin1Char( ',' ) && ! quoted )
+			{
+				fields << field;
+				field.clear();
+			}
+			else
+			{
+				field += c;
+			}
+		}
+		fields << field;
+		return fields;
+	}
+
+	// testlib's csv benchmark log:
+	// "function","tag","metric",value per iteration,total,iterations
+	bool writeJson( QString const& csv, QString const& filename )
+	{
+		QFile in( csv );
+		if( ! in.open( QFile::ReadOnly | QFile::Text ) )
+		{
+			return false;
+		}
+
+		QJsonArray results;
+		while( ! in.atEnd() )
+		{
+			QStringList f = csvFields( QString::fromUtf8( in.readLine() ).trimmed() );
+			if( f.size() < 6 )
+			{
+				continue;
+			}
+
+			QJsonObject r;
+			r.insert( QStringLiteral( "benchmark" ), f[0] );
+			r.insert( QStringLiteral( "tag" ), f[1] );
+			r.insert( QStringLiteral( "lines" ), f[1].left( f[1].size() - 1 ).toInt() * 1000 );
+			r.insert( QStringLiteral( "metric" ), f[2] );
+			r.insert( QStringLiteral( "value" ), f[3].toDouble() );
+			r.insert( QStringLiteral( "iterations" ), f[5].toInt() );
+			results.append( r );
+		}
+
+		QJsonObject root;
+		root.insert( QStringLiteral( "qt" ), QString::fromLatin1( qVersion() ) );
+		root.insert( QStringLiteral( "date" ), QDateTime::currentDateTimeUtc().toString( Qt::ISODate ) );
+		root.insert( QStringLiteral( "results" ), results );
+
+		QFile out( filename );
+		if( ! out.open( QFile::WriteOnly | QFile::Truncate ) )
+		{
+			return false;
+		}
+		out.write( QJsonDocument( root ).toJson() );
+		return true;
+	}
+}
+
+
+int main( int argc, char* argv[] )
+{
+	// results should not depend on the desktop they were taken on
+	if( ! qEnvironmentVariableIsSet( "QT_QPA_PLATFORM" ) )
+	{
+		qputenv( "QT_QPA_PLATFORM", "offscreen" );
+	}
+
+	QApplication app( argc, argv );
+
+	// keep the editor's settings out of it
+	app.setApplicationName( "luaeditor-bench" );
+	app.setOrganizationDomain( "mattski.net.nz" );
+
+	// no edit journals (or recovery prompts) from the forms created here
+	QSettings().setValue( QStringLiteral( "lua/journal" ), false );
+
+	QStringList args = app.arguments();
+
+	// --json <file>: also log csv and convert it for regression tracking
+	QString json;
+	QTemporaryFile csv;
+	int i = args.indexOf( QStringLiteral( "--json" ) );
+	if( i > 0 && i + 1 < args.size() )
+	{
+		json = args.at( i + 1 );
+		args.erase( args.begin() + i, args.begin() + i + 2 );
+
+		if( ! csv.open() )
+		{
+			qCritical( "cannot create a temporary file" );
+			return 2;
+		}
+		csv.close();
+		args << QStringLiteral( "-o" ) << QStringLiteral( "-,txt" )
+			<< QStringLiteral( "-o" ) << csv.fileName() + QStringLiteral( ",csv" );
+	}
+
+	EditorBench bench;
+	int rc = QTest::qExec( &bench, args );
+
+	if( ! json.isEmpty() && ! writeJson( csv.fileName(), json ) )
+	{
+		qCritical( "cannot write %s", qPrintable( json ) );
+		return 2;
+	}
+
+	return rc;
+}
+
+#include "main.moc"
@@ -0,0 +1,27 @@
+#-------------------------------------------------
+#
+# Project created by QtCreator 2016-09-10T19:59:27
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = LuaEditor
+TEMPLATE = app
+
+
+include(engine.pri)
+include(widgets.pri)
+
+SOURCES += main.cpp\
+		MainWindow.cpp
+
+HEADERS  += MainWindow.h
+
+FORMS    += MainWindow.ui
+
+
+DISTFILES += \
+    README.md
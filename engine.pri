@@ -0,0 +1,23 @@
+# Lua vm thread and pool, console redirection and profiler, shared by the gui and luarun
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+	$$PWD/LuaThread.cpp \
+	$$PWD/LuaPool.cpp \
+	$$PWD/LuaProfiler.cpp \
+	$$PWD/LuaAllocator.cpp \
+	$$PWD/LuaBytecodeCache.cpp \
+	$$PWD/RingBuffer.cpp
+
+HEADERS += \
+	$$PWD/LuaThread.h \
+	$$PWD/LuaPool.h \
+	$$PWD/LuaProfiler.h \
+	$$PWD/LuaAllocator.h \
+	$$PWD/LuaBytecodeCache.h \
+	$$PWD/RingBuffer.h
+
+CONFIG += link_pkgconfig
+PKGCONFIG = lua5.3-c++
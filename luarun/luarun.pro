@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Headless runner: executes scripts with the same vm setup as the editor
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = luarun
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../engine.pri)
+
+SOURCES += main.cpp
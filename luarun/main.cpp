@@ -0,0 +1,186 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHash>
+#include <QThread>
+
+#include <cstdio>
+
+#include "LuaPool.h"
+#include "LuaBytecodeCache.h"
+
+
+namespace
+{
+	char const* describe( LuaThread::ExitStatus status )
+	{
+		switch( status )
+		{
+			case LuaThread::NormalExit:		return "ok";
+			case LuaThread::ErrorExit:		return "error";
+			case LuaThread::StoppedExit:	return "stopped";
+		}
+		return "?";
+	}
+
+	void print( QByteArray const& data )
+	{
+		std::fwrite( data.constData(), 1, size_t( data.size() ), stdout );
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+
+	a.setApplicationName( "luarun" );
+	a.setApplicationVersion( "0.1" );
+	a.setOrganizationDomain( "mattski.net.nz" );
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription( QLatin1String( "Runs Lua scripts with the LuaEditor console and search paths." ) );
+	parser.addHelpOption();
+	parser.addVersionOption();
+
+	QCommandLineOption includeOption( QStringList() << "I" << "include",
+		QLatin1String( "Add <dir> to package.path (after the script's own directory)." ), QLatin1String( "dir" ) );
+	QCommandLineOption jobsOption( QStringList() << "j" << "jobs",
+		QLatin1String( "Run up to <n> scripts at once, each in its own Lua state (0: one per core)." ), QLatin1String( "n" ), QLatin1String( "1" ) );
+	QCommandLineOption warmOption( QLatin1String( "warm" ),
+		QLatin1String( "Keep each worker's Lua state and loaded packages between scripts." ) );
+	QCommandLineOption memoryOption( QStringList() << "m" << "memory-limit",
+		QLatin1String( "Fail allocations once a script holds more than <mb> megabytes." ), QLatin1String( "mb" ), QLatin1String( "0" ) );
+	QCommandLineOption timeOption( QStringList() << "t" << "timeout",
+		QLatin1String( "Stop a script after <s> seconds of wall time." ), QLatin1String( "s" ), QLatin1String( "0" ) );
+	QCommandLineOption cpuOption( QLatin1String( "cpu-limit" ),
+		QLatin1String( "Stop a script after <s> seconds of cpu time." ), QLatin1String( "s" ), QLatin1String( "0" ) );
+	QCommandLineOption instructionOption( QLatin1String( "instruction-limit" ),
+		QLatin1String( "Stop a script after about <n> vm instructions." ), QLatin1String( "n" ), QLatin1String( "0" ) );
+	QCommandLineOption noCacheOption( QLatin1String( "no-cache" ),
+		QLatin1String( "Always compile from source, bypassing the bytecode cache." ) );
+	QCommandLineOption quietOption( QStringList() << "q" << "quiet",
+		QLatin1String( "Do not report status and timings on stderr." ) );
+
+	parser.addOption( includeOption );
+	parser.addOption( jobsOption );
+	parser.addOption( warmOption );
+	parser.addOption( memoryOption );
+	parser.addOption( timeOption );
+	parser.addOption( cpuOption );
+	parser.addOption( instructionOption );
+	parser.addOption( noCacheOption );
+	parser.addOption( quietOption );
+	parser.addPositionalArgument( QLatin1String( "scripts" ), QLatin1String( "Scripts to run." ), QLatin1String( "script..." ) );
+
+	parser.process( a );
+
+	QStringList scripts = parser.positionalArguments();
+	if( scripts.isEmpty() )
+	{
+		parser.showHelp( 2 );
+	}
+
+	QStringList includes = parser.values( includeOption );
+	bool quiet = parser.isSet( quietOption );
+
+	int jobs = parser.value( jobsOption ).toInt();
+	if( jobs <= 0 )
+	{
+		jobs = qMax( 1, QThread::idealThreadCount() );
+	}
+	jobs = qMin( jobs, scripts.size() );
+
+	LuaPool pool;
+	pool.setWorkers( jobs );
+	pool.setWarm( parser.isSet( warmOption ) );
+	pool.setMemoryLimit( parser.value( memoryOption ).toULongLong() << 20 );
+	pool.setBytecodeCache( ! parser.isSet( noCacheOption ) );
+
+	LuaThread::Budget budget;
+	budget.wallSeconds = parser.value( timeOption ).toDouble();
+	budget.cpuSeconds = parser.value( cpuOption ).toDouble();
+	budget.instructions = parser.value( instructionOption ).toULongLong();
+	pool.setBudget( budget );
+
+	QHash<int, QString> names;
+	int unreadable = 0;
+
+	// with several scripts at once every line is tagged with its script
+	if( jobs == 1 )
+	{
+		QObject::connect( &pool, &LuaPool::jobOutput, []( int, QString const& text ){
+			print( text.toUtf8() );
+		} );
+	}
+	else
+	{
+		QObject::connect( &pool, &LuaPool::jobTaggedOutput, []( int, QString const& text ){
+			print( text.toUtf8() );
+		} );
+	}
+
+	QObject::connect( &pool, &LuaPool::jobFinished, [&]( int id, LuaThread::Statistics const& stats ){
+		std::fflush( stdout );
+
+		if( ! quiet )
+		{
+			QByteArray status = describe( stats.status );
+			if( stats.status == LuaThread::StoppedExit && stats.stopReason != LuaThread::StopRequested )
+			{
+				status += QByteArray( " (" ) + LuaThread::describe( stats.stopReason ) + ")";
+			}
+
+			std::fprintf( stderr, "%s: %s, %.3f s wall, %.3f s cpu, %llu instructions, %llu bytes output, %.1f MB peak, %d/%d chunks cached\n",
+				qPrintable( names.value( id ) ), status.constData(),
+				stats.wallSeconds, stats.cpuSeconds,
+				static_cast<unsigned long long>( stats.instructions ),
+				static_cast<unsigned long long>( stats.outputBytes ),
+				stats.peakBytes / ( 1024.0 * 1024.0 ),
+				stats.cacheHits, stats.cacheHits + stats.cacheMisses );
+		}
+	} );
+
+	QObject::connect( &pool, &LuaPool::finished, [&]{
+		std::fflush( stdout );
+
+		LuaPool::Summary summary = pool.summary();
+		if( ! quiet && ! parser.isSet( noCacheOption ) )
+		{
+			LuaBytecodeCache::Statistics cache = LuaBytecodeCache::instance()->statistics();
+			std::fprintf( stderr, "bytecode cache: %llu memory hits, %llu disk hits, %llu misses\n",
+				static_cast<unsigned long long>( cache.memoryHits ),
+				static_cast<unsigned long long>( cache.diskHits ),
+				static_cast<unsigned long long>( cache.misses ) );
+		}
+
+		if( ! quiet && summary.jobs > 1 )
+		{
+			std::fprintf( stderr, "%d scripts, %d failed, %d workers: %.3f s wall, %.3f s cpu, %.1f scripts/s, "
+				"latency mean %.3f s, p95 %.3f s, max %.3f s\n",
+				summary.jobs, summary.failures, pool.workers(),
+				summary.wallSeconds, summary.cpuSeconds, summary.jobsPerSecond(),
+				summary.meanLatency, summary.p95Latency, summary.maxLatency );
+		}
+
+		a.exit( ( summary.failures + unreadable ) > 0 ? 1 : 0 );
+	} );
+
+	for( auto const& script : scripts )
+	{
+		int id = pool.submitFile( script, includes );
+		if( id < 0 )
+		{
+			std::fprintf( stderr, "%s: cannot open\n", qPrintable( script ) );
+			++unreadable;
+			continue;
+		}
+		names.insert( id, script );
+	}
+
+	if( pool.isIdle() )
+	{
+		return 1;
+	}
+
+	return a.exec();
+}
@@ -0,0 +1,39 @@
+# Editor widgets (LuaForm and everything under it), shared by the gui and bench
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+	$$PWD/LuaForm.cpp \
+	$$PWD/LuaHighlighter.cpp \
+	$$PWD/LuaLexer.cpp \
+	$$PWD/LuaStructure.cpp \
+	$$PWD/LineView.cpp \
+	$$PWD/OutputView.cpp \
+	$$PWD/MappedFile.cpp \
+	$$PWD/LargeFileView.cpp \
+	$$PWD/CodeEditor.cpp \
+	$$PWD/SyntaxChecker.cpp \
+	$$PWD/SearchIndex.cpp \
+	$$PWD/FindBar.cpp \
+	$$PWD/FileWriter.cpp \
+	$$PWD/EditJournal.cpp
+
+HEADERS += \
+	$$PWD/LuaForm.h \
+	$$PWD/LuaHighlighter.h \
+	$$PWD/LuaLexer.h \
+	$$PWD/LuaStructure.h \
+	$$PWD/LineView.h \
+	$$PWD/OutputView.h \
+	$$PWD/MappedFile.h \
+	$$PWD/LargeFileView.h \
+	$$PWD/CodeEditor.h \
+	$$PWD/SyntaxChecker.h \
+	$$PWD/SearchIndex.h \
+	$$PWD/FindBar.h \
+	$$PWD/FileWriter.h \
+	$$PWD/EditJournal.h
+
+FORMS += \
+	$$PWD/LuaForm.ui